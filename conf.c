@@ -17,7 +17,6 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <search.h>
 #include <getopt.h>
 
 #include "util.h"
@@ -37,23 +36,18 @@ typedef struct {
 } entry_t;
 
 /* Data */
-static void  *conf;
+#define str_eq(a, b) (!strcmp(a, b))
+HASHMAP(entries, const char*, entry_t*, hash_str, str_eq)
+
+static entries_t conf;
 static int    conf_argc;
 static char **conf_argv;
 static char   conf_path[256];
 
 /* Helpers */
-static int entry_cmp(const void *_a, const void *_b)
-{
-	const entry_t *a = _a;
-	const entry_t *b = _b;
-	return strcmp(a->key, b->key);
-}
-
 static entry_t *entry_get(const char *key)
 {
-	entry_t try = { .key = (char*)key };
-	entry_t **found = tfind(&try, &conf, entry_cmp);
+	entry_t **found = entries_get(&conf, key);
 	return found ? *found : NULL;
 }
 
@@ -71,7 +65,7 @@ static void entry_set(const char *key, int num, const char *str)
 
 	/* Free old item */
 	if ((entry = entry_get(key))) {
-		tdelete(entry, &conf, entry_cmp);
+		entries_del(&conf, key);
 		entry_free(entry);
 	}
 
@@ -87,7 +81,7 @@ static void entry_set(const char *key, int num, const char *str)
 		entry->num  = num;
 		//printf("set_num: %s = %d\n", key, num);
 	}
-	tsearch(entry, &conf, entry_cmp);
+	entries_put(&conf, entry->key, entry);
 }
 
 static char *strtrim(char *str)
@@ -271,5 +265,7 @@ void conf_init(int argc, char **argv)
 
 void conf_free(void)
 {
-	tdestroy(conf, (void(*)(void*))entry_free);
+	hash_foreach(&conf, slot)
+		entry_free(slot->val);
+	entries_free(&conf);
 }
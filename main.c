@@ -15,6 +15,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <signal.h>
 
 #include "util.h"
@@ -28,19 +29,65 @@ void on_sigint(int signum)
 	sys_exit();
 }
 
+#ifdef SIGUSR1
+/* Dump the trace ring on SIGUSR1 or when crashing,
+ * the previous handlers are still run afterwards */
+static char trace_path[256];
+static int  trace_sigs[] = {SIGUSR1, SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+static struct sigaction trace_prev[countof(trace_sigs)];
+
+static void on_trace(int signum)
+{
+	ring_dump(trace_path);
+	for (int i = 0; i < countof(trace_sigs); i++) {
+		if (trace_sigs[i] != signum)
+			continue;
+		if (signum != SIGUSR1) {
+			sigaction(signum, &trace_prev[i], NULL);
+			raise(signum);
+		} else if (trace_prev[i].sa_handler != SIG_DFL &&
+		           trace_prev[i].sa_handler != SIG_IGN) {
+			trace_prev[i].sa_handler(signum);
+		}
+	}
+}
+
+static void trace_init(void)
+{
+	const char *path = conf_get_str("main.trace", "/tmp/wmpus.trace");
+	strncpy(trace_path, path, sizeof(trace_path)-1);
+	struct sigaction act = {.sa_handler = on_trace};
+	sigemptyset(&act.sa_mask);
+	for (int i = 0; i < countof(trace_sigs); i++)
+		sigaction(trace_sigs[i], &act, &trace_prev[i]);
+}
+#else
+static void trace_init(void)
+{
+}
+#endif
+
 int main(int argc, char **argv)
 {
-	setbuf(stdout, NULL); // debug
+#ifdef DEBUG
+	setbuf(stdout, NULL);
+#endif
 	signal(SIGINT, on_sigint);
 
 	conf_init(argc, argv);
+	log_mask = conf_get_int("main.log", log_mask);
 	sys_init();
 	wm_init();
+	trace_init();
 
 	sys_run();
 
 	wm_free();
 	sys_free();
 	conf_free();
+
+	debug(LOG_SYS, "list nodes: %d used, %d mallocs\n",
+			list_pool.gets, list_pool.allocs);
+	pool_free(&list_pool);
 	return 0;
 }
@@ -16,7 +16,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
-#include <search.h>
 
 #define WIN32_LEAN_AND_MEAN
 #define _WIN32_WINNT 0x0501
@@ -39,66 +38,71 @@ struct win_sys {
 	HWND hwnd;
 };
 
-typedef struct {
-	event_t ev;
-	int     vk;
-} event_map_t;
+/* Window cache, indexed by handle */
+#define hwnd_eq(a, b) ((a) == (b))
+#define hwnd_hash(hwnd) hash_int((unsigned long)(hwnd))
+HASHMAP(cache, HWND, win_t*, hwnd_hash, hwnd_eq)
 
 /* Global data */
 static int     shellhookid;
-static void   *cache;
+static cache_t cache;
 static HWND    root;
 static list_t *screens;
 
-/* Conversion functions */
-static event_map_t ev2vk[] = {
-	{EV_MOUSE1  , VK_LBUTTON },
-	{EV_MOUSE2  , VK_MBUTTON },
-	{EV_MOUSE3  , VK_RBUTTON },
-	{EV_LEFT    , VK_LEFT    },
-	{EV_RIGHT   , VK_RIGHT   },
-	{EV_UP      , VK_UP      },
-	{EV_DOWN    , VK_DOWN    },
-	{EV_HOME    , VK_HOME    },
-	{EV_END     , VK_END     },
-	{EV_PAGEUP  , VK_PRIOR   },
-	{EV_PAGEDOWN, VK_NEXT    },
-	{EV_F1      , VK_F1      },
-	{EV_F2      , VK_F2      },
-	{EV_F3      , VK_F3      },
-	{EV_F4      , VK_F4      },
-	{EV_F5      , VK_F5      },
-	{EV_F6      , VK_F6      },
-	{EV_F7      , VK_F7      },
-	{EV_F8      , VK_F8      },
-	{EV_F9      , VK_F9      },
-	{EV_F10     , VK_F10     },
-	{EV_F11     , VK_F11     },
-	{EV_F12     , VK_F12     },
-	{EV_SHIFT   , VK_SHIFT   },
-	{EV_SHIFT   , VK_LSHIFT  },
-	{EV_SHIFT   , VK_RSHIFT  },
-	{EV_CTRL    , VK_CONTROL },
-	{EV_CTRL    , VK_LCONTROL},
-	{EV_CTRL    , VK_RCONTROL},
-	{EV_ALT     , VK_MENU    },
-	{EV_ALT     , VK_LMENU   },
-	{EV_ALT     , VK_RMENU   },
-	{EV_WIN     , VK_LWIN    },
-	{EV_WIN     , VK_RWIN    },
-};
+/* Conversion functions
+ *   KEY maps both ways, ALIAS only maps virtual keys to events */
+#define KEYS(KEY, ALIAS)               \
+	KEY  (EV_MOUSE1  , VK_LBUTTON ) \
+	KEY  (EV_MOUSE2  , VK_MBUTTON ) \
+	KEY  (EV_MOUSE3  , VK_RBUTTON ) \
+	KEY  (EV_LEFT    , VK_LEFT    ) \
+	KEY  (EV_RIGHT   , VK_RIGHT   ) \
+	KEY  (EV_UP      , VK_UP      ) \
+	KEY  (EV_DOWN    , VK_DOWN    ) \
+	KEY  (EV_HOME    , VK_HOME    ) \
+	KEY  (EV_END     , VK_END     ) \
+	KEY  (EV_PAGEUP  , VK_PRIOR   ) \
+	KEY  (EV_PAGEDOWN, VK_NEXT    ) \
+	KEY  (EV_F1      , VK_F1      ) \
+	KEY  (EV_F2      , VK_F2      ) \
+	KEY  (EV_F3      , VK_F3      ) \
+	KEY  (EV_F4      , VK_F4      ) \
+	KEY  (EV_F5      , VK_F5      ) \
+	KEY  (EV_F6      , VK_F6      ) \
+	KEY  (EV_F7      , VK_F7      ) \
+	KEY  (EV_F8      , VK_F8      ) \
+	KEY  (EV_F9      , VK_F9      ) \
+	KEY  (EV_F10     , VK_F10     ) \
+	KEY  (EV_F11     , VK_F11     ) \
+	KEY  (EV_F12     , VK_F12     ) \
+	KEY  (EV_SHIFT   , VK_SHIFT   ) \
+	ALIAS(EV_SHIFT   , VK_LSHIFT  ) \
+	ALIAS(EV_SHIFT   , VK_RSHIFT  ) \
+	KEY  (EV_CTRL    , VK_CONTROL ) \
+	ALIAS(EV_CTRL    , VK_LCONTROL) \
+	ALIAS(EV_CTRL    , VK_RCONTROL) \
+	KEY  (EV_ALT     , VK_MENU    ) \
+	ALIAS(EV_ALT     , VK_LMENU   ) \
+	ALIAS(EV_ALT     , VK_RMENU   ) \
+	KEY  (EV_WIN     , VK_LWIN    ) \
+	ALIAS(EV_WIN     , VK_RWIN    )
+
+/* Virtual key codes are all below 0x100 */
+#define EV2VK(ev, vk) [ev - EV_MOUSE0] = vk,
+#define VK2EV(ev, vk) [vk]             = ev,
+#define NOMAP(ev, vk)
+static UINT    ev2vk[]      = { KEYS(EV2VK, NOMAP) };
+static event_t vk2ev[0x100] = { KEYS(VK2EV, VK2EV) };
 
 /* - Keycodes */
 static event_t w2ev(UINT vk)
 {
-	event_map_t *em = map_getr(ev2vk,vk);
-	return em ? em->ev : tolower(vk);
+	return map_get(vk2ev, 0, vk, tolower(vk));
 }
 
 static UINT ev2w(event_t ev)
 {
-	event_map_t *em = map_get(ev2vk,ev);
-	return em ? em->vk : toupper(ev);
+	return map_get(ev2vk, EV_MOUSE0, ev, toupper(ev));
 }
 
 static mod_t getmod(void)
@@ -142,37 +146,27 @@ static win_t *win_new(HWND hwnd, int checkwin)
 	win->h         = rect.bottom - rect.top;
 	win->sys       = new0(win_sys_t);
 	win->sys->hwnd = hwnd;
-	printf("win_new: %p = %p (%d,%d %dx%d)\n", win, hwnd,
+	trace(LOG_SYS, "win_new: %p = %p (%d,%d %dx%d)\n", win, hwnd,
 			win->x, win->y, win->w, win->h);
 	return win;
 }
 
-static int win_cmp(const void *_a, const void *_b)
-{
-	const win_t *a = _a, *b = _b;
-	if (a->sys->hwnd < b->sys->hwnd) return -1;
-	if (a->sys->hwnd > b->sys->hwnd) return  1;
-	return 0;
-}
-
 static win_t *win_find(HWND hwnd, int create)
 {
 	if (!hwnd)
 		return NULL;
 	//printf("win_find: %p, %d\n", dpy, (int)xid);
-	win_sys_t sys = {.hwnd=hwnd};
-	win_t     tmp = {.sys=&sys};
 	win_t **old = NULL, *new = NULL;
-	if ((old = tfind(&tmp, &cache, win_cmp)))
+	if ((old = cache_get(&cache, hwnd)))
 		return *old;
 	if (create && (new = win_new(hwnd,1)))
-		tsearch(new, &cache, win_cmp);
+		cache_put(&cache, hwnd, new);
 	return new;
 }
 
 static void win_remove(win_t *win)
 {
-	tdelete(win, &cache, win_cmp);
+	cache_del(&cache, win->sys->hwnd);
 	free(win->sys);
 	free(win);
 }
@@ -196,7 +190,7 @@ LRESULT CALLBACK KbdProc(int msg, WPARAM wParam, LPARAM lParam)
 	event_t ev = w2ev(st->vkCode);
 	mod_t mod = getmod();
 	mod.up = !!(st->flags & 0x80);
-	printf("KbdProc: %d,%x,%lx - %lx,%lx,%lx - %x,%x\n",
+	trace(LOG_EVENT, "KbdProc: %d,%x,%lx - %lx,%lx,%lx - %x,%x\n",
 			msg, wParam, lParam,
 			st->vkCode, st->scanCode, st->flags,
 			ev, mod2int(mod));
@@ -242,7 +236,7 @@ LRESULT CALLBACK ShlProc(int msg, WPARAM wParam, LPARAM lParam)
 	switch (msg) {
 	case HSHELL_REDRAW:
 	case HSHELL_WINDOWCREATED:
-		printf("ShlProc: %p - %s\n", hwnd, msg == HSHELL_REDRAW ?
+		trace(LOG_EVENT, "ShlProc: %p - %s\n", hwnd, msg == HSHELL_REDRAW ?
 				"redraw" : "window created");
 		if (!(win = win_find(hwnd,0)))
 			if ((win = win_find(hwnd,1)))
@@ -250,7 +244,7 @@ LRESULT CALLBACK ShlProc(int msg, WPARAM wParam, LPARAM lParam)
 		return 1;
 	case HSHELL_WINDOWREPLACED:
 	case HSHELL_WINDOWDESTROYED:
-		printf("ShlProc: %p - %s\n", hwnd, msg == HSHELL_WINDOWREPLACED ?
+		trace(LOG_EVENT, "ShlProc: %p - %s\n", hwnd, msg == HSHELL_WINDOWREPLACED ?
 				"window replaced" : "window destroyed");
 		if ((win = win_find(hwnd,0)) &&
 		    (win->state == ST_SHOW ||
@@ -260,13 +254,13 @@ LRESULT CALLBACK ShlProc(int msg, WPARAM wParam, LPARAM lParam)
 		}
 		return 1;
 	case HSHELL_WINDOWACTIVATED:
-		printf("ShlProc: %p - window activated\n", hwnd);
+		trace(LOG_EVENT, "ShlProc: %p - window activated\n", hwnd);
 		// Fake button-click (causes crazy switching)
 		//if ((win = win_find(hwnd,0)))
 		//	wm_handle_event(win, EV_MOUSE1, MOD(), getptr());
 		return 0;
 	default:
-		printf("ShlProc: %p - unknown msg, %d\n", hwnd, msg);
+		trace(LOG_EVENT, "ShlProc: %p - unknown msg, %d\n", hwnd, msg);
 		return 0;
 	}
 }
@@ -275,10 +269,11 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
 	//printf("WndProc: %d, %x, %lx\n", msg, wParam, lParam);
 	switch (msg) {
-	case WM_CREATE:  printf("WndProc: %p - create\n",  hwnd); return 0;
-	case WM_CLOSE:   printf("WndProc: %p - close\n",   hwnd); return 0;
-	case WM_DESTROY: printf("WndProc: %p - destroy\n", hwnd); return 0;
-	case WM_HOTKEY:  printf("WndProc: %p - hotkey\n",  hwnd); return 0;
+	case WM_CREATE:  trace(LOG_EVENT, "WndProc: %p - create\n",  hwnd); return 0;
+	case WM_CLOSE:   trace(LOG_EVENT, "WndProc: %p - close\n",   hwnd); return 0;
+	case WM_DESTROY: trace(LOG_EVENT, "WndProc: %p - destroy\n", hwnd); return 0;
+	case WM_HOTKEY:  trace(LOG_EVENT, "WndProc: %p - hotkey\n",  hwnd); return 0;
+	case WM_TIMER:   KillTimer(hwnd, wParam); wm_handle_timer(); return 0;
 	}
 	if (msg == shellhookid)
 		if (ShlProc(wParam, lParam, 0))
@@ -300,7 +295,7 @@ BOOL CALLBACK MonProc(HMONITOR mon, HDC dc, LPRECT rect, LPARAM _screens)
 	screen->w = work->right  - work->left;
 	screen->h = work->bottom - work->top;
 	*screens = list_append(*screens, screen);
-	printf("mon_proc: %d,%d %dx%d\n",
+	info(LOG_SYS, "mon_proc: %d,%d %dx%d\n",
 		screen->x, screen->y, screen->w, screen->h);
 	return TRUE;
 }
@@ -324,7 +319,7 @@ BOOL WINAPI CtrlProc(DWORD type)
  ********************/
 void sys_move(win_t *win, int x, int y, int w, int h)
 {
-	printf("sys_move: %p - %d,%d  %dx%d\n", win, x, y, w, h);
+	trace(LOG_SYS, "sys_move: %p - %d,%d  %dx%d\n", win, x, y, w, h);
 	win->x = x; win->y = y;
 	win->w = MAX(w,1); win->h = MAX(h,1);
 	MoveWindow(win->sys->hwnd, win->x, win->y, win->w, win->h, TRUE);
@@ -332,7 +327,7 @@ void sys_move(win_t *win, int x, int y, int w, int h)
 
 void sys_raise(win_t *win)
 {
-	printf("sys_raise: %p\n", win);
+	trace(LOG_SYS, "sys_raise: %p\n", win);
 
 	/* See note in sys_focus */
 	DWORD oldId = GetWindowThreadProcessId(GetForegroundWindow(), NULL);
@@ -346,7 +341,7 @@ void sys_raise(win_t *win)
 
 void sys_focus(win_t *win)
 {
-	printf("sys_focus: %p\n", win);
+	trace(LOG_SYS, "sys_focus: %p\n", win);
 
 	/* Windows prevents a thread from using SetForegroundInput under
 	 * certain circumstances and instead flashes the windows toolbar icon.
@@ -383,7 +378,7 @@ void sys_show(win_t *win, state_t state)
 	if (win->state != state && win->state == ST_SHADE)
 		SetWindowRgn(win->sys->hwnd, NULL, TRUE);
 	win->state = state;
-	printf("sys_show: %s\n", map[state].str);
+	trace(LOG_SYS, "sys_show: %s\n", map[state].str);
 	ShowWindow(win->sys->hwnd, map[state].cmd);
 	if (state == ST_SHADE)
 		SetWindowRgn(win->sys->hwnd, CreateRectRgn(0,0,win->w,stack), TRUE);
@@ -401,6 +396,11 @@ void sys_unwatch(win_t *win, event_t ev, mod_t mod)
 	//printf("sys_unwatch: %p\n", win);
 }
 
+void sys_timer(int msec)
+{
+	SetTimer(root, 1, msec, NULL);
+}
+
 list_t *sys_info(void)
 {
 	if (screens == NULL)
@@ -16,7 +16,6 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
-#include <search.h>
 #include <string.h>
 
 #include <xcb/xcb.h>
@@ -31,6 +30,7 @@
 #include "types.h"
 #include "sys.h"
 #include "wm.h"
+#include "x11.h"
 
 /* Configuration */
 static int border     = 2;
@@ -38,17 +38,9 @@ static int stack      = 25;
 static int no_capture = 0;
 
 /* Internal structures */
-typedef struct {
-	int left;
-	int right;
-	int top;
-	int bottom;
-} strut_t;
-
 struct win_sys {
-	xcb_window_t     xcb;    // xcb window id
+	x11_t            x11;    // common x11 data
 	xcb_event_mask_t events; // currently watch events
-	strut_t          strut;  // toolbar struts
 	state_t          state;  // window state if not mapped
 	xcb_window_t     parent; // transient for window
 	int mapped;              // window is managed by wm
@@ -62,12 +54,10 @@ static xcb_key_symbols_t     *keysyms;
 static xcb_colormap_t         colormap;
 static xcb_window_t           root;
 static xcb_event_mask_t       events;
-static list_t                *screens;
-static list_t                *struts;
-static void                  *cache;
 static unsigned int           grabbed;
 static int                    running;
 static xcb_window_t           control;
+static xcb_timestamp_t        last_time;
 
 static xcb_pixmap_t           clr_focus;
 static xcb_pixmap_t           clr_unfocus;
@@ -75,49 +65,41 @@ static xcb_pixmap_t           clr_urgent;
 
 static xcb_atom_t             wm_protos;
 static xcb_atom_t             wm_delete;
+static xcb_atom_t             wm_focus;
 static xcb_atom_t             wm_nhints;
 
 /************************
  * Conversion functions *
  ************************/
 
-/* State names */
-static char *state_map[] = {
-	[ST_HIDE ] "hide ",
-	[ST_SHOW ] "show ",
-	[ST_FULL ] "full ",
-	[ST_MAX  ] "max  ",
-	[ST_SHADE] "shade",
-	[ST_ICON ] "icon ",
-	[ST_CLOSE] "close",
-};
-
 /* Key presses */
-static struct {
-	event_t      ev;
-	xcb_keysym_t sym;
-} keysym_map[] = {
-	{ EV_LEFT,     0xFF51 },
-	{ EV_RIGHT,    0xFF53 },
-	{ EV_UP,       0xFF52 },
-	{ EV_DOWN,     0xFF54 },
-	{ EV_HOME,     0xFF50 },
-	{ EV_END,      0xFF57 },
-	{ EV_PAGEUP,   0xFF55 },
-	{ EV_PAGEDOWN, 0xFF56 },
-	{ EV_F1,       0xFFBE },
-	{ EV_F2,       0xFFBF },
-	{ EV_F3,       0xFFC0 },
-	{ EV_F4,       0xFFC1 },
-	{ EV_F5,       0xFFC2 },
-	{ EV_F6,       0xFFC3 },
-	{ EV_F7,       0xFFC4 },
-	{ EV_F8,       0xFFC5 },
-	{ EV_F9,       0xFFC6 },
-	{ EV_F10,      0xFFC7 },
-	{ EV_F11,      0xFFC8 },
-	{ EV_F12,      0xFFC9 },
-};
+#define KEYS(KEY)                \
+	KEY( EV_LEFT,     0xFF51 ) \
+	KEY( EV_RIGHT,    0xFF53 ) \
+	KEY( EV_UP,       0xFF52 ) \
+	KEY( EV_DOWN,     0xFF54 ) \
+	KEY( EV_HOME,     0xFF50 ) \
+	KEY( EV_END,      0xFF57 ) \
+	KEY( EV_PAGEUP,   0xFF55 ) \
+	KEY( EV_PAGEDOWN, 0xFF56 ) \
+	KEY( EV_F1,       0xFFBE ) \
+	KEY( EV_F2,       0xFFBF ) \
+	KEY( EV_F3,       0xFFC0 ) \
+	KEY( EV_F4,       0xFFC1 ) \
+	KEY( EV_F5,       0xFFC2 ) \
+	KEY( EV_F6,       0xFFC3 ) \
+	KEY( EV_F7,       0xFFC4 ) \
+	KEY( EV_F8,       0xFFC5 ) \
+	KEY( EV_F9,       0xFFC6 ) \
+	KEY( EV_F10,      0xFFC7 ) \
+	KEY( EV_F11,      0xFFC8 ) \
+	KEY( EV_F12,      0xFFC9 )
+
+/* Both directions are indexed directly, keysyms by their low byte */
+#define EV2SYM(ev, sym) [ev  - EV_LEFT] = sym,
+#define SYM2EV(ev, sym) [sym - 0xFF00 ] = ev,
+static xcb_keysym_t ev2sym[]      = { KEYS(EV2SYM) };
+static event_t      sym2ev[0x100] = { KEYS(SYM2EV) };
 
 /************************
  * Conversion functions *
@@ -128,7 +110,7 @@ static xcb_keycode_t *event_to_keycodes(event_t ev)
 	xcb_keycode_t *codes = NULL;
 
 	/* Get keysym */
-	xcb_keysym_t keysym = map_get(keysym_map, ev, ev, sym, ev);
+	xcb_keysym_t keysym = map_get(ev2sym, EV_LEFT, ev, ev);
 
 	/* Get keycodes */
 	if (!(codes = xcb_key_symbols_get_keycode(keysyms, keysym)))
@@ -143,7 +125,7 @@ static event_t keycode_to_event(xcb_keycode_t code)
 	xcb_keysym_t keysym = xcb_key_symbols_get_keysym(keysyms, code, 0);
 
 	/* Get event */
-	return map_get(keysym_map, sym,keysym, ev,keysym);
+	return map_get(sym2ev, 0xFF00, keysym, keysym);
 }
 
 /* Button presses */
@@ -195,87 +177,51 @@ static ptr_t list_to_ptr(int16_t *list)
  * Window functions *
  ********************/
 
-static int win_cmp(const void *_a, const void *_b)
-{
-	const win_t *a = _a;
-	const win_t *b = _b;
-	if (a->sys->xcb < b->sys->xcb) return -1;
-	if (a->sys->xcb > b->sys->xcb) return  1;
-	return 0;
-}
-
 static win_t *win_get(xcb_window_t xcb)
 {
-	win_sys_t sys = { .xcb =  xcb };
-	win_t     key = { .sys = &sys };
+	win_t *win = x11_win_find(xcb);
 
-	win_t   **win = tfind(&key, &cache, win_cmp);
-
-	if (!win) {
+	if (!win)
 		warn("no window for %u", xcb);
-		return NULL;
-	}
 
-	return *win;
+	return win;
 }
 
 static win_t *win_new(xcb_window_t xcb)
 {
 	win_t *win = new0(win_t);
 	win->sys = new0(win_sys_t);
-	win->sys->xcb = xcb;
+	X11(win)->xid = xcb;
 
-	win_t **old = tfind(win, &cache, win_cmp);
-	if (old) {
+	win_t *old = x11_win_add(win);
+	if (old != win) {
 		warn("duplicate window for %u\n", xcb);
 		free(win->sys);
 		free(win);
-		return *old;
+		return old;
 	}
 
-	tsearch(win, &cache, win_cmp);
-	printf("win_new: xcb=%-8u -> win=%p\n",
-			win->sys->xcb, win);
+	trace(LOG_SYS, "win_new: xcb=%-8u -> win=%p\n",
+			X11(win)->xid, win);
 	return win;
 }
 
 static void win_free(win_t *win)
 {
-	printf("win_free: xcb=%-8u -> win=%p\n",
-			win->sys->xcb, win);
+	trace(LOG_SYS, "win_free: xcb=%-8u -> win=%p\n",
+			X11(win)->xid, win);
 	free(win->sys);
 	free(win);
 }
 
-static void win_add_strut(win_t *win)
-{
-	win->type = TYPE_TOOLBAR;
-	for (list_t *cur = screens; cur; cur = cur->next) {
-		win_t   *screen = cur->data;
-		strut_t *strut  = &win->sys->strut;
-		screen->x += strut->left;
-		screen->y += strut->top;
-		screen->w -= strut->left + strut->right;
-		screen->h -= strut->top  + strut->bottom;
-	}
-	struts = list_insert(struts, win);
+static int do_get_strut(xcb_window_t xcb, strut_t *strut);
 
-}
-
-static void win_del_strut(win_t *win)
+static void win_add_strut(win_t *win)
 {
-	list_t *link = list_find(struts, win);
-	if (!link)
-		return;
-	for (list_t *cur = screens; cur; cur = cur->next) {
-		win_t   *screen = cur->data;
-		strut_t *strut  = &win->sys->strut;
-		screen->x -= strut->left;
-		screen->y -= strut->top;
-		screen->w += strut->left + strut->right;
-		screen->h += strut->top  + strut->bottom;
-	}
-	struts = list_remove(struts, link, 0);
+	strut_t strut;
+	do_get_strut(X11(win)->xid, &strut);
+	if (x11_strut(win, &strut))
+		win->type = TYPE_TOOLBAR;
 }
 
 /****************
@@ -296,7 +242,7 @@ static void *do_query_tree(xcb_window_t xcb, xcb_window_t **kids, int *nkids)
 
 	*nkids = xcb_query_tree_children_length(reply);
 	*kids  = xcb_query_tree_children(reply);
-	printf("do_query_tree: %d - n=%d\n", xcb, *nkids);
+	trace(LOG_SYS, "do_query_tree: %d - n=%d\n", xcb, *nkids);
 	return reply;
 }
 
@@ -313,7 +259,7 @@ static int do_get_geometry(xcb_window_t xcb,
 	if (!reply)
 		return warn("do_get_geometry: %d - no reply", xcb);
 
-	printf("do_get_geometry: %d - %dx%d @ %d,%d\n",
+	trace(LOG_SYS, "do_get_geometry: %d - %dx%d @ %d,%d\n",
 			xcb, reply->width, reply->height, reply->x, reply->y);
 	*x = reply->x;
 	*y = reply->y;
@@ -336,7 +282,7 @@ static int do_get_window_attributes(xcb_window_t xcb,
 	if (!reply)
 		return warn("do_get_window_attributes: %d - no reply ", xcb);
 
-	printf("do_get_window_attributes: %d - %d\n",
+	trace(LOG_SYS, "do_get_window_attributes: %d - %d\n",
 			xcb, reply->override_redirect);
 	*override = reply->override_redirect;
 	*mapped   = reply->map_state != XCB_MAP_STATE_UNMAPPED;
@@ -361,7 +307,7 @@ static int do_xinerama_check(void)
 	if (!reply)
 		return warn("do_xinerama_check: no reply");
 
-	printf("do_xinerama_check: %d\n", reply->state);
+	trace(LOG_SYS, "do_xinerama_check: %d\n", reply->state);
 	int state = reply->state;
 	free(reply);
 	return state;
@@ -381,7 +327,7 @@ static void *do_query_screens(xcb_xinerama_screen_info_t **info, int *ninfo)
 
 	*ninfo = xcb_xinerama_query_screens_screen_info_length(reply);
 	*info  = xcb_xinerama_query_screens_screen_info(reply);
-	printf("do_query_screens: %d screens\n", *ninfo);
+	trace(LOG_SYS, "do_query_screens: %d screens\n", *ninfo);
 	return reply;
 }
 
@@ -472,7 +418,7 @@ static int do_get_type(xcb_window_t xcb, type_t *type)
 		if (reply.atoms[i] == ewmh._NET_WM_WINDOW_TYPE_DIALOG)
 			*type = TYPE_DIALOG;
 	}
-	printf("do_get_type: %d -> %d\n", prev, *type);
+	trace(LOG_SYS, "do_get_type: %d -> %d\n", prev, *type);
 	return 1;
 }
 
@@ -489,8 +435,8 @@ static int do_get_icccm_state(xcb_window_t xcb, state_t *state)
 		return warn("do_get_icccm_state: no sizes");
 
 	state_t prev = *state;
-	printf("do_get_icccm_state: %s -> %s\n",
-			state_map[prev], state_map[*state]);
+	trace(LOG_SYS, "do_get_icccm_state: %s -> %s\n",
+			x11_state(prev), x11_state(*state));
 	return 1;
 }
 
@@ -511,13 +457,31 @@ static int do_get_ewmh_state(xcb_window_t xcb, state_t *state)
 		if (states.atoms[i] == ewmh._NET_WM_STATE_FULLSCREEN)
 			*state = ST_FULL;
 
-	printf("do_get_ewmh_state: %s -> %s\n",
-			state_map[prev], state_map[*state]);
+	trace(LOG_SYS, "do_get_ewmh_state: %s -> %s\n",
+			x11_state(prev), x11_state(*state));
 	return 1;
 }
 
 static int do_get_strut(xcb_window_t xcb, strut_t *strut)
 {
+	*strut = (strut_t){};
+
+	/* Prefer _NET_WM_STRUT_PARTIAL */
+	xcb_get_property_cookie_t pcookie =
+		xcb_ewmh_get_wm_strut_partial(&ewmh, xcb);
+	xcb_ewmh_wm_strut_partial_t part = {};
+	if (pcookie.sequence &&
+	    xcb_ewmh_get_wm_strut_partial_reply(&ewmh, pcookie, &part, NULL)) {
+		*strut = (strut_t){
+			part.left, part.right, part.top, part.bottom,
+			part.left_start_y,   part.left_end_y,
+			part.right_start_y,  part.right_end_y,
+			part.top_start_x,    part.top_end_x,
+			part.bottom_start_x, part.bottom_end_x,
+		};
+		return part.left || part.right || part.top || part.bottom;
+	}
+
 	xcb_get_property_cookie_t cookie =
 		xcb_ewmh_get_wm_strut(&ewmh, xcb);
 	if (!cookie.sequence)
@@ -548,7 +512,30 @@ static int do_get_transient(xcb_window_t xcb, xcb_window_t *parent)
 	if (!xcb_icccm_get_wm_transient_for_reply(conn, cookie, parent, NULL))
 		return warn("do_get_transient: no sizes");
 
-	printf("do_get_transient: %d -> %d\n", xcb, *parent);
+	trace(LOG_SYS, "do_get_transient: %d -> %d\n", xcb, *parent);
+	return 1;
+}
+
+static int do_get_protocols(xcb_window_t xcb, proto_t *protos)
+{
+	*protos = 0;
+
+	xcb_get_property_cookie_t cookie =
+		xcb_icccm_get_wm_protocols(conn, xcb, wm_protos);
+	if (!cookie.sequence)
+		return warn("do_get_protocols: %d - bad cookie", xcb);
+
+	xcb_icccm_get_wm_protocols_reply_t reply = {};
+	if (!xcb_icccm_get_wm_protocols_reply(conn, cookie, &reply, NULL))
+		return 0;
+
+	for (int i = 0; i < reply.atoms_len; i++) {
+		if (reply.atoms[i] == wm_delete) *protos |= PROTO_DELETE;
+		if (reply.atoms[i] == wm_focus)  *protos |= PROTO_FOCUS;
+	}
+	xcb_icccm_get_wm_protocols_reply_wipe(&reply);
+
+	trace(LOG_SYS, "do_get_protocols: %d -> %x\n", xcb, *protos);
 	return 1;
 }
 
@@ -567,7 +554,7 @@ static xcb_pixmap_t do_alloc_color(uint32_t rgb)
 	if (!reply)
 		return warn("do_alloc_color: no reply");
 
-	printf("do_alloc_color: %06x -> %06x\n", rgb, reply->pixel);
+	trace(LOG_SYS, "do_alloc_color: %06x -> %06x\n", rgb, reply->pixel);
 	xcb_pixmap_t pixel = reply->pixel;
 	free(reply);
 	return pixel;
@@ -616,39 +603,29 @@ static void do_configure_window(xcb_window_t xcb,
 	xcb_configure_window(conn, xcb, mask, list);
 }
 
-static int do_client_message(xcb_window_t xcb, xcb_atom_t atom)
+static void do_configure(win_t *win,
+		int x, int y, int w, int h,
+		int b, int r)
+{
+	/* Skip geometry the server already has */
+	if (!x11_geom(win, x, y, w, h, b))
+		x = y = w = h = b = -1;
+	if (x >= 0 || y >= 0 || w >= 0 || h >= 0 || b >= 0 || r >= 0)
+		do_configure_window(X11(win)->xid, x, y, w, h, b, -1, r);
+}
+
+static void do_client_message(xcb_window_t xcb, xcb_atom_t atom)
 {
-	/* Get protocols */
-	xcb_get_property_cookie_t cookie =
-		xcb_icccm_get_wm_protocols(conn, xcb, wm_protos);
-	if (!cookie.sequence)
-		return warn("do_client_message: %d - bad cookie", xcb);
-
-	xcb_icccm_get_wm_protocols_reply_t protos = {};
-	if (!xcb_icccm_get_wm_protocols_reply(conn, cookie, &protos, NULL))
-		return warn("do_client_message: %d - no reply", xcb);
-
-	/* Search for the atom */
-	int found = 0;
-	for (int i = 0; i < protos.atoms_len; i++)
-		if (protos.atoms[i] == atom)
-			found = 1;
-	xcb_icccm_get_wm_protocols_reply_wipe(&protos);
-	if (!found)
-		return warn("do_client_message: %d - no atom", xcb);
-
-	/* Send the message */
 	xcb_client_message_event_t msg = {
 		.response_type  = XCB_CLIENT_MESSAGE,
 		.format         = 32,
 		.window         = xcb,
 		.type           = wm_protos,
 		.data.data32[0] = atom,
-		.data.data32[1] = XCB_CURRENT_TIME,
+		.data.data32[1] = last_time,
 	};
 	xcb_send_event(conn, 0, xcb, XCB_EVENT_MASK_NO_EVENT,
 			(const char *)&msg);
-	return 1;
 }
 
 /**************************
@@ -725,7 +702,7 @@ static void send_state(win_t *win, state_t next)
 /* Specific events */
 static void on_key_event(xcb_key_press_event_t *event, int up)
 {
-	printf("on_key_event:         xcb=%-8u\n", event->event);
+	trace(LOG_EVENT, "on_key_event:         xcb=%-8u\n", event->event);
 	xcb_window_t focus = do_get_input_focus();
 	event_t ev = keycode_to_event(event->detail);
 	send_event_info(ev, event->state, up, &event->root_x,
@@ -734,7 +711,7 @@ static void on_key_event(xcb_key_press_event_t *event, int up)
 
 static void on_button_event(xcb_button_press_event_t *event, int up)
 {
-	printf("on_button_event:      xcb=%-8u\n", event->event);
+	trace(LOG_EVENT, "on_button_event:      xcb=%-8u\n", event->event);
 	event_t ev = button_to_event(event->detail);
 	if (!send_event_info(ev, event->state, up, &event->root_x,
 				event->root, event->event, event->child))
@@ -749,7 +726,7 @@ static void on_button_event(xcb_button_press_event_t *event, int up)
 
 static void on_motion_notify(xcb_motion_notify_event_t *event)
 {
-	printf("on_motion_notify:     xcb=%-8u - %d,%d / %d.%d\n", event->event,
+	trace(LOG_EVENT, "on_motion_notify:     xcb=%-8u - %d,%d / %d.%d\n", event->event,
 			event->event_x, event->event_y,
 			event->root_x,  event->root_y);
 	send_pointer(&event->root_x, event->root, event->event, event->child);
@@ -759,7 +736,7 @@ static void on_enter_notify(xcb_enter_notify_event_t *event)
 {
 	if (event->mode != XCB_NOTIFY_MODE_NORMAL)
 		return;
-	printf("on_enter_notify:      xcb=%-8u\n", event->event);
+	trace(LOG_EVENT, "on_enter_notify:      xcb=%-8u\n", event->event);
 	send_event_info(EV_ENTER, event->state, 0, &event->root_x,
 		event->root, event->event, event->child);
 }
@@ -768,7 +745,7 @@ static void on_leave_notify(xcb_leave_notify_event_t *event)
 {
 	if (event->mode != XCB_NOTIFY_MODE_NORMAL)
 		return;
-	printf("on_leave_notify:      xcb=%-8u\n", event->event);
+	trace(LOG_EVENT, "on_leave_notify:      xcb=%-8u\n", event->event);
 	send_event_info(EV_LEAVE, event->state, 0, &event->root_x,
 		event->root, event->event, event->child);
 }
@@ -778,7 +755,7 @@ static void on_focus_in(xcb_focus_in_event_t *event)
 	if (event->mode != XCB_NOTIFY_MODE_NORMAL &&
 	    event->mode != XCB_NOTIFY_MODE_WHILE_GRABBED)
 		return;
-	printf("on_focus_in:          xcb=%-8u mode=%d\n", event->event, event->mode);
+	trace(LOG_EVENT, "on_focus_in:          xcb=%-8u mode=%d\n", event->event, event->mode);
 	xcb_change_window_attributes(conn, event->event,
 			XCB_CW_BORDER_PIXEL, &clr_focus);
 	if (event->mode == XCB_NOTIFY_MODE_NORMAL)
@@ -790,7 +767,7 @@ static void on_focus_out(xcb_focus_out_event_t *event)
 	if (event->mode != XCB_NOTIFY_MODE_NORMAL &&
 	    event->mode != XCB_NOTIFY_MODE_WHILE_GRABBED)
 		return;
-	printf("on_focus_out:         xcb=%-8u mode=%d\n", event->event, event->mode);
+	trace(LOG_EVENT, "on_focus_out:         xcb=%-8u mode=%d\n", event->event, event->mode);
 	xcb_change_window_attributes(conn, event->event,
 			XCB_CW_BORDER_PIXEL, &clr_unfocus);
 	if (event->mode == XCB_NOTIFY_MODE_NORMAL)
@@ -799,7 +776,7 @@ static void on_focus_out(xcb_focus_out_event_t *event)
 
 static void on_create_notify(xcb_create_notify_event_t *event)
 {
-	printf("on_create_notify:     xcb=%-8u\n", event->window);
+	trace(LOG_EVENT, "on_create_notify:     xcb=%-8u\n", event->window);
 
 	win_t *win = win_new(event->window);
 
@@ -818,28 +795,30 @@ static void on_create_notify(xcb_create_notify_event_t *event)
 
 	if (do_get_transient(event->window, &win->sys->parent))
 		win->parent = win_get(win->sys->parent);
+
+	do_get_protocols(event->window, &X11(win)->protos);
 }
 
 static void on_destroy_notify(xcb_destroy_notify_event_t *event)
 {
 	win_t *win = win_get(event->window);
-	printf("on_destroy_notify:    xcb=%-8u -> win=%p\n",
+	trace(LOG_EVENT, "on_destroy_notify:    xcb=%-8u -> win=%p\n",
 			event->window, win);
 	if (!win) return;
 
 	send_manage(win, 0);
-	tdelete(win, &cache, win_cmp);
+	x11_win_del(win);
 	win_free(win);
 }
 
 static void on_unmap_notify(xcb_unmap_notify_event_t *event)
 {
 	win_t *win = win_get(event->window);
-	printf("on_unmap_notify:      xcb=%-8u -> win=%p\n",
+	trace(LOG_EVENT, "on_unmap_notify:      xcb=%-8u -> win=%p\n",
 			event->window, win);
 	if (!win) return;
 
-	win_del_strut(win);
+	x11_strut(win, NULL);
 	send_state(win, ST_HIDE);
 	win->sys->mapped = 0;
 }
@@ -847,7 +826,7 @@ static void on_unmap_notify(xcb_unmap_notify_event_t *event)
 static void on_map_notify(xcb_map_notify_event_t *event)
 {
 	win_t *win = win_get(event->window);
-	printf("on_map_notify:        xcb=%-8u -> win=%p\n",
+	trace(LOG_EVENT, "on_map_notify:        xcb=%-8u -> win=%p\n",
 			event->window, win);
 	if (!win) return;
 
@@ -858,13 +837,13 @@ static void on_map_notify(xcb_map_notify_event_t *event)
 static void on_map_request(xcb_map_request_event_t *event)
 {
 	win_t *win = win_get(event->window);
-	printf("on_map_request:       xcb=%-8u -> win=%p\n",
+	trace(LOG_EVENT, "on_map_request:       xcb=%-8u -> win=%p\n",
 			event->window, win);
 	if (!win) return;
 
 	win->sys->mapped = 1;
 	send_state(win, win->sys->state);
-	xcb_map_window(conn, win->sys->xcb);
+	xcb_map_window(conn, X11(win)->xid);
 	if (!win->sys->managed)
 		sys_move(win, win->x, win->y, win->w, win->h);
 }
@@ -872,12 +851,12 @@ static void on_map_request(xcb_map_request_event_t *event)
 static void on_configure_request(xcb_configure_request_event_t *event)
 {
 	win_t *win = win_get(event->window);
-	printf("on_configure_request: xcb=%-8u -> win=%p -- %dx%d @ %d,%d\n",
+	trace(LOG_EVENT, "on_configure_request: xcb=%-8u -> win=%p -- %dx%d @ %d,%d\n",
 			event->window, win,
 			event->width, event->height,
 			event->x, event->y);
 	if (!win) return;
-	printf("on_configure_request: xcb=%-8u -> win=%p << %dx%d @ %d,%d\n",
+	trace(LOG_EVENT, "on_configure_request: xcb=%-8u -> win=%p << %dx%d @ %d,%d\n",
 			event->window, win,
 			win->w, win->h,
 			win->x, win->y);
@@ -891,8 +870,8 @@ static void on_configure_request(xcb_configure_request_event_t *event)
 
 	xcb_configure_notify_event_t resp = {
 		.response_type = XCB_CONFIGURE_NOTIFY,
-		.event         = win->sys->xcb,
-		.window        = win->sys->xcb,
+		.event         = X11(win)->xid,
+		.window        = X11(win)->xid,
 		.x             = win->x,
 		.y             = win->y,
 		.width         = win->w,
@@ -900,7 +879,7 @@ static void on_configure_request(xcb_configure_request_event_t *event)
 		.border_width  = border,
 	};
 
-	xcb_send_event(conn, 0, win->sys->xcb,
+	xcb_send_event(conn, 0, X11(win)->xid,
 			XCB_EVENT_MASK_STRUCTURE_NOTIFY,
 			(const char *)&resp);
 }
@@ -908,10 +887,12 @@ static void on_configure_request(xcb_configure_request_event_t *event)
 static void on_property_notify(xcb_property_notify_event_t *event)
 {
 	win_t *win = win_get(event->window);
-	char *name = do_get_atom_name(event->atom);
-	printf("on_property_notify: xcb=%-8u -> win=%p - %s\n",
-			event->window, win, name);
-	if (name) free(name);
+	if (logging(LOG_TRACE, LOG_EVENT)) {
+		char *name = do_get_atom_name(event->atom);
+		trace(LOG_EVENT, "on_property_notify: xcb=%-8u -> win=%p - %s\n",
+				event->window, win, name);
+		if (name) free(name);
+	}
 	if (!win) return;
 
 	/* Check window type */
@@ -919,9 +900,13 @@ static void on_property_notify(xcb_property_notify_event_t *event)
 		do_get_type(event->window, &win->type);
 
 	/* Check struts */
-	if (event->atom == ewmh._NET_WM_STRUT)
-		if (do_get_strut(win->sys->xcb, &win->sys->strut))
-			win_add_strut(win);
+	if (event->atom == ewmh._NET_WM_STRUT ||
+	    event->atom == ewmh._NET_WM_STRUT_PARTIAL)
+		win_add_strut(win);
+
+	/* Check supported protocols */
+	if (event->atom == wm_protos)
+		do_get_protocols(event->window, &X11(win)->protos);
 
 	/* Check transient for */
 	if (event->atom == XCB_ATOM_WM_TRANSIENT_FOR)
@@ -940,25 +925,27 @@ static void on_property_notify(xcb_property_notify_event_t *event)
 static void on_client_message(xcb_client_message_event_t *event)
 {
 	win_t *win = win_get(event->window);
-	char *name = do_get_atom_name(event->type);
-	printf("on_client_message: xcb=%-8u -> win=%p - %s=[%d,%d,%d,%d]\n",
-			event->window, win, name,
-			event->data.data32[0], event->data.data32[1],
-			event->data.data32[2], event->data.data32[3]);
-	if (name) free(name);
+	if (logging(LOG_TRACE, LOG_EVENT)) {
+		char *name = do_get_atom_name(event->type);
+		trace(LOG_EVENT, "on_client_message: xcb=%-8u -> win=%p - %s=[%d,%d,%d,%d]\n",
+				event->window, win, name,
+				event->data.data32[0], event->data.data32[1],
+				event->data.data32[2], event->data.data32[3]);
+		if (name) free(name);
+	}
 	if (!win) return;
 
 	/* Exit request */
 	if (event->window         == control   &&
 	    event->type           == wm_protos &&
 	    event->data.data32[0] == wm_delete) {
-		printf("on_client_message: shutdown request");
+		trace(LOG_EVENT, "on_client_message: shutdown request");
 		running = 0;
 	}
 
 	/* Close request */
 	if (event->type == ewmh._NET_CLOSE_WINDOW) {
-		printf("on_client_message: close request");
+		trace(LOG_EVENT, "on_client_message: close request");
 		sys_show(win, ST_CLOSE);
 	}
 
@@ -966,7 +953,7 @@ static void on_client_message(xcb_client_message_event_t *event)
 	if ((event->type           == ewmh._NET_WM_STATE) &&
 	    (event->data.data32[1] == ewmh._NET_WM_STATE_FULLSCREEN ||
 	     event->data.data32[2] == ewmh._NET_WM_STATE_FULLSCREEN)) {
-		printf("on_client_message: fullscreen request");
+		trace(LOG_EVENT, "on_client_message: fullscreen request");
 	     	int full = win->state == ST_FULL;
 	     	switch (event->data.data32[0]) {
 	     		case XCB_EWMH_WM_STATE_REMOVE: full  = 0; break;
@@ -981,9 +968,67 @@ static void on_client_message(xcb_client_message_event_t *event)
 }
 
 /* Generic Event */
+static xcb_window_t event_window(xcb_generic_event_t *event, int type)
+{
+	switch (type) {
+		case XCB_KEY_PRESS:
+		case XCB_KEY_RELEASE:
+		case XCB_BUTTON_PRESS:
+		case XCB_BUTTON_RELEASE:
+		case XCB_MOTION_NOTIFY:
+			return ((xcb_key_press_event_t *)event)->event;
+		case XCB_ENTER_NOTIFY:
+		case XCB_LEAVE_NOTIFY:
+			return ((xcb_enter_notify_event_t *)event)->event;
+		case XCB_FOCUS_IN:
+		case XCB_FOCUS_OUT:
+			return ((xcb_focus_in_event_t *)event)->event;
+		case XCB_CREATE_NOTIFY:
+			return ((xcb_create_notify_event_t *)event)->window;
+		case XCB_DESTROY_NOTIFY:
+			return ((xcb_destroy_notify_event_t *)event)->window;
+		case XCB_UNMAP_NOTIFY:
+			return ((xcb_unmap_notify_event_t *)event)->window;
+		case XCB_MAP_NOTIFY:
+			return ((xcb_map_notify_event_t *)event)->window;
+		case XCB_MAP_REQUEST:
+			return ((xcb_map_request_event_t *)event)->window;
+		case XCB_CONFIGURE_REQUEST:
+			return ((xcb_configure_request_event_t *)event)->window;
+		case XCB_PROPERTY_NOTIFY:
+			return ((xcb_property_notify_event_t *)event)->window;
+		case XCB_CLIENT_MESSAGE:
+			return ((xcb_client_message_event_t *)event)->window;
+		default:
+			return 0;
+	}
+}
+
+static xcb_timestamp_t event_time(xcb_generic_event_t *event, int type)
+{
+	switch (type) {
+		case XCB_KEY_PRESS:
+		case XCB_KEY_RELEASE:
+		case XCB_BUTTON_PRESS:
+		case XCB_BUTTON_RELEASE:
+		case XCB_MOTION_NOTIFY:
+			return ((xcb_key_press_event_t *)event)->time;
+		case XCB_ENTER_NOTIFY:
+		case XCB_LEAVE_NOTIFY:
+			return ((xcb_enter_notify_event_t *)event)->time;
+		case XCB_PROPERTY_NOTIFY:
+			return ((xcb_property_notify_event_t *)event)->time;
+		default:
+			return XCB_CURRENT_TIME;
+	}
+}
+
 static void on_event(xcb_generic_event_t *event)
 {
 	int type = XCB_EVENT_RESPONSE_TYPE(event);
+	ring_put(RING_EVENT, event_window(event, type), type, 0, 0, 0);
+	if (event_time(event, type) != XCB_CURRENT_TIME)
+		last_time = event_time(event, type);
 
 	switch (type) {
 		/* Input handling */
@@ -1043,7 +1088,7 @@ static void on_event(xcb_generic_event_t *event)
 
 		/* Unknown events */
 		default:
-			printf("on_event: %d:%02X -> %s\n",
+			trace(LOG_EVENT, "on_event: %d:%02X -> %s\n",
 				XCB_EVENT_SENT(event) != 0,
 				XCB_EVENT_RESPONSE_TYPE(event),
 				xcb_event_get_label(type) ?: "unknown_event");
@@ -1057,109 +1102,102 @@ static void on_event(xcb_generic_event_t *event)
 
 void sys_move(win_t *win, int x, int y, int w, int h)
 {
-	printf("sys_move:  %p - %dx%d @ %d,%d\n",
+	trace(LOG_SYS, "sys_move:  %p - %dx%d @ %d,%d\n",
 			win, w, h, x, y);
+	ring_put(RING_MOVE, X11(win)->xid, x, y, w, h);
 
-	int b = 2*border;
-
-	win->x = x;
-	win->y = y;
-	win->w = MAX(w,1+b);
-	win->h = MAX(h,1+b);
-	w      = MAX(w-b,1);
-	h      = MAX(h-b,1);
-
-	do_configure_window(win->sys->xcb, x, y, w, h, -1, -1, -1);
+	if (x11_move(win, x, y, w, h, border)) {
+		geom_t *geom = &X11(win)->geom;
+		do_configure_window(X11(win)->xid,
+				geom->x, geom->y, geom->w, geom->h,
+				-1, -1, -1);
+	}
 }
 
 void sys_raise(win_t *win)
 {
-	printf("sys_raise: %p\n", win);
+	trace(LOG_SYS, "sys_raise: %p\n", win);
+	ring_put(RING_RAISE, X11(win)->xid, 0, 0, 0, 0);
 
 	uint16_t mask = XCB_CONFIG_WINDOW_STACK_MODE;
 	uint32_t list = XCB_STACK_MODE_ABOVE;
 
-	xcb_configure_window(conn, win->sys->xcb, mask, &list);
-	for (list_t *cur = struts; cur; cur = cur->next)
+	xcb_configure_window(conn, X11(win)->xid, mask, &list);
+	for (list_t *cur = x11_struts(); cur; cur = cur->next)
 		xcb_configure_window(conn,
-			((win_t*)cur->data)->sys->xcb, mask, &list);
+			X11((win_t*)cur->data)->xid, mask, &list);
 }
 
 void sys_focus(win_t *win)
 {
-	printf("sys_focus: %p\n", win);
-	xcb_window_t xcb = win ? win->sys->xcb : root;
+	trace(LOG_SYS, "sys_focus: %p\n", win);
+	xcb_window_t xcb = win ? X11(win)->xid : root;
+	ring_put(RING_FOCUS, xcb, 0, 0, 0, 0);
 
 	xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT,
 			xcb, XCB_CURRENT_TIME);
+	if (win && X11(win)->protos & PROTO_FOCUS)
+		do_client_message(xcb, wm_focus);
 }
 
 void sys_show(win_t *win, state_t state)
 {
-	printf("sys_show:  %p - %s -> %s\n", win,
-			state_map[win->state], state_map[state]);
-	xcb_window_t xcb = win ? win->sys->xcb : root;
+	trace(LOG_SYS, "sys_show:  %p - %s -> %s\n", win,
+			x11_state(win->state), x11_state(state));
+	xcb_window_t xcb = win ? X11(win)->xid : root;
+	ring_put(RING_SHOW, xcb, state, 0, 0, 0);
 
 	/* Find screen */
-	win_t full, max;
-	if (state == ST_FULL || state == ST_MAX) {
-		for (list_t *cur = screens; cur; cur = cur->next) {
-			full = max = *(win_t*)cur->data;
-			if (win->x >= max.x && win->x < max.x+max.w &&
-			    win->y >= max.y && win->y < max.y+max.h)
-				break;
-		}
-		for (list_t *cur = struts; cur; cur = cur->next) {
-			strut_t *strut = &((win_t*)cur->data)->sys->strut;
-			full.x -= strut->left;
-			full.y -= strut->top;
-			full.w += strut->left + strut->right;
-			full.h += strut->top  + strut->bottom;
-		}
-	}
+	geom_t full, max;
+	if (state == ST_FULL || state == ST_MAX)
+		x11_area(win, &max, &full);
 
-	/* Change window state */
+	/* Change window state
+	 *   Windows are configured before they are mapped
+	 *   so they never appear at their old size */
 	switch (state) {
 		case ST_HIDE:
 			xcb_unmap_window(conn, xcb);
 			break;
 
 		case ST_SHOW:
-			xcb_map_window(conn, xcb);
-			do_configure_window(xcb, win->x, win->y,
+			do_configure(win, win->x, win->y,
 					MAX(win->w - 2*border, 1),
 					MAX(win->h - 2*border, 1),
-					border, -1, -1);
+					border, -1);
+			xcb_map_window(conn, xcb);
 			break;
 
 		case ST_FULL:
+			do_configure(win, full.x, full.y, full.w, full.h,
+					0, XCB_STACK_MODE_ABOVE);
 			xcb_map_window(conn, xcb);
-			do_configure_window(xcb, full.x, full.y, full.w, full.h,
-					0, -1, XCB_STACK_MODE_ABOVE);
 			break;
 
 		case ST_MAX:
-			xcb_map_window(conn, xcb);
-			do_configure_window(xcb, max.x, max.y,
+			do_configure(win, max.x, max.y,
 					MAX(max.w - 2*border, 1),
 					MAX(max.h - 2*border, 1),
-					border, -1, XCB_STACK_MODE_ABOVE);
+					border, XCB_STACK_MODE_ABOVE);
+			xcb_map_window(conn, xcb);
 			break;
 
 		case ST_SHADE:
+			do_configure(win, -1, -1, -1, stack,
+					border, -1);
 			xcb_map_window(conn, xcb);
-			do_configure_window(xcb, -1, -1, -1, stack,
-					border, -1, -1);
 			break;
 
 		case ST_ICON:
+			do_configure(win, -1, -1, 100, 100,
+					border, -1);
 			xcb_map_window(conn, xcb);
-			do_configure_window(xcb, -1, -1, 100, 100,
-					border, -1, -1);
 			break;
 
 		case ST_CLOSE:
-			if (!do_client_message(xcb, wm_delete))
+			if (X11(win)->protos & PROTO_DELETE)
+				do_client_message(xcb, wm_delete);
+			else
 				xcb_kill_client(conn, xcb);
 			break;
 	}
@@ -1170,8 +1208,8 @@ void sys_show(win_t *win, state_t state)
 
 void sys_watch(win_t *win, event_t ev, mod_t mod)
 {
-	printf("sys_watch: %p - 0x%X,0x%X\n", win, ev, mod2int(mod));
-	xcb_window_t      xcb  = win ? win->sys->xcb     : root;
+	trace(LOG_SYS, "sys_watch: %p - 0x%X,0x%X\n", win, ev, mod2int(mod));
+	xcb_window_t      xcb  = win ? X11(win)->xid     : root;
 	xcb_event_mask_t *mask = win ? &win->sys->events : &events;
 	xcb_mod_mask_t    mods = 0;
 	xcb_button_t      btn  = 0;
@@ -1219,57 +1257,54 @@ void sys_watch(win_t *win, event_t ev, mod_t mod)
 
 void sys_unwatch(win_t *win, event_t ev, mod_t mod)
 {
-	printf("sys_unwatch: %p - 0x%X,0x%X\n", win, ev, mod2int(mod));
+	trace(LOG_SYS, "sys_unwatch: %p - 0x%X,0x%X\n", win, ev, mod2int(mod));
+}
+
+void sys_timer(int msec)
+{
+	trace(LOG_SYS, "sys_timer: %d ms\n", msec);
+	x11_timer(msec);
 }
 
 list_t *sys_info(void)
 {
-	printf("sys_info\n");
+	info(LOG_SYS, "sys_info\n");
 
-	if (screens == NULL && do_xinerama_check()) {
+	if (x11_screens() == NULL && do_xinerama_check()) {
 		/* Add Xinerama screens */
 		int ninfo = 0;
 		xcb_xinerama_screen_info_t *info = NULL;
 		void *reply = do_query_screens(&info, &ninfo);
 		for (int i = 0; i < ninfo; i++) {
-			win_t *screen = new0(win_t);
-
-			screen->x = info[i].x_org;
-			screen->y = info[i].y_org;
-			screen->w = info[i].width;
-			screen->h = info[i].height;
-
-			screens = list_insert(screens, screen);
+			x11_screen(info[i].x_org, info[i].y_org,
+			           info[i].width, info[i].height);
 
-			printf("sys_info: xinerama screen - %dx%d @ %d,%d\n",
-					screen->w, screen->h,
-					screen->x, screen->y);
+			info(LOG_SYS, "sys_info: xinerama screen - %dx%d @ %d,%d\n",
+					info[i].width, info[i].height,
+					info[i].x_org, info[i].y_org);
 		}
 		free(reply);
 	}
 
-	if (screens == NULL) {
+	if (x11_screens() == NULL) {
 		/* No xinerama support */
 		const xcb_setup_t *setup = xcb_get_setup(conn);
 		xcb_screen_t      *geom  = xcb_setup_roots_iterator(setup).data;
 
-		win_t *screen = new0(win_t);
+		x11_screen(0, 0, geom->width_in_pixels,
+		                 geom->height_in_pixels);
 
-		screen->w = geom->width_in_pixels;
-		screen->h = geom->height_in_pixels;
-
-		screens = list_insert(screens, screen);
-
-		printf("sys_info: root screen - %dx%d\n",
-				screen->w, screen->h);
+		info(LOG_SYS, "sys_info: root screen - %dx%d\n",
+				geom->width_in_pixels,
+				geom->height_in_pixels);
 	}
 
-	return screens;
+	return x11_screens();
 }
 
 void sys_init(void)
 {
-	printf("sys_init\n");
+	info(LOG_SYS, "sys_init\n");
 
 	xcb_void_cookie_t cookie;
 	xcb_generic_error_t *err;
@@ -1302,8 +1337,9 @@ void sys_init(void)
 	/* Setup X Atoms */
 	wm_protos = do_intern_atom("WM_PROTOCOLS");
 	wm_delete = do_intern_atom("WM_DELETE_WINDOW");
+	wm_focus  = do_intern_atom("WM_TAKE_FOCUS");
 	wm_nhints = do_intern_atom("WM_NORMAL_HINTS");
-	if (!wm_protos || !wm_delete || !wm_nhints)
+	if (!wm_protos || !wm_delete || !wm_focus || !wm_nhints)
 		error("unable to setup atoms");
 
 	/* Setup EWMH connection */
@@ -1314,7 +1350,7 @@ void sys_init(void)
 	/* Set EWMH wm window */
 	uint32_t override = 1;
 	control = xcb_generate_id(conn);
-	printf("control window: %d\n", control);
+	info(LOG_SYS, "control window: %d\n", control);
 	cookie  = xcb_create_window_checked(conn, 0, control, root,
 			0, 0, 1, 1, 0, 0, 0,
 			XCB_CW_OVERRIDE_REDIRECT, &override);
@@ -1342,7 +1378,7 @@ void sys_init(void)
 
 void sys_run(void)
 {
-	printf("sys_run\n");
+	info(LOG_SYS, "sys_run\n");
 
 	/* Add each initial window */
 	if (!no_capture) {
@@ -1354,17 +1390,17 @@ void sys_run(void)
 			if (kids[i] == control)
 				continue;
 			win_t *win = win_new(kids[i]);
-			if (do_get_strut(win->sys->xcb, &win->sys->strut))
-				win_add_strut(win);
+			win_add_strut(win);
 			do_get_geometry(kids[i], &win->x, &win->y, &win->w, &win->h);
 			do_get_window_attributes(kids[i], &override, &mapped);
-			printf("  found %-8u %dx%d @ %d,%d --%s%s\n", kids[i],
+			info(LOG_SYS, "  found %-8u %dx%d @ %d,%d --%s%s\n", kids[i],
 					win->w, win->h, win->x, win->y,
 					override ? " override" : "",
 					mapped   ? " mapped"   : "");
 			state_t state = mapped ? ST_SHOW : ST_HIDE;
 			win->sys->mapped = mapped;
 			do_get_type(kids[i], &win->type);
+			do_get_protocols(kids[i], &X11(win)->protos);
 			do_get_icccm_state(kids[i], &state);
 			do_get_ewmh_state(kids[i], &state);
 			send_manage(win, !override);
@@ -1379,11 +1415,15 @@ void sys_run(void)
 	while (running)
 	{
 		int status;
-		xcb_generic_event_t *event;
-		if (!(event = xcb_wait_for_event(conn)))
-			break;
-		on_event(event);
-		free(event);
+		xcb_generic_event_t *event = xcb_poll_for_queued_event(conn);
+		if (event || x11_wait(xcb_get_file_descriptor(conn))) {
+			if (!event && !(event = xcb_wait_for_event(conn)))
+				break;
+			on_event(event);
+			free(event);
+		} else {
+			wm_handle_timer();
+		}
 		if (!(status = xcb_flush(conn)))
 			break;
 	}
@@ -1391,7 +1431,7 @@ void sys_run(void)
 
 void sys_exit(void)
 {
-	printf("sys_exit\n");
+	info(LOG_SYS, "sys_exit\n");
 
 	xcb_client_message_event_t msg = {
 		.response_type  = XCB_CLIENT_MESSAGE,
@@ -1408,7 +1448,7 @@ void sys_exit(void)
 
 void sys_free(void)
 {
-	printf("sys_free\n");
+	info(LOG_SYS, "sys_free\n");
 
 	xcb_void_cookie_t cookie;
 	xcb_generic_error_t *err;
@@ -1429,7 +1469,5 @@ void sys_free(void)
 	xcb_disconnect(conn);
 
 	/* free local data */
-	while (screens)
-		screens = list_remove(screens, screens, 1);
-	tdestroy(cache, (void(*)(void*))win_free);
+	x11_free(win_free);
 }
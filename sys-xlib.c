@@ -16,7 +16,7 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
-#include <search.h>
+#include <signal.h>
 
 #include <X11/Xlib.h>
 #include <X11/Xproto.h>
@@ -29,6 +29,7 @@
 #include "types.h"
 #include "sys.h"
 #include "wm.h"
+#include "x11.h"
 
 /* Configuration */
 static int border     = 2;
@@ -37,25 +38,23 @@ static int stack      = 25;
 
 /* Internal structures */
 struct win_sys {
-	Window   xid;
+	x11_t    x11;
 	Display *dpy;
-	struct {
-		int left, right, top, bottom;
-	} strut;
 };
 
-typedef struct {
-	event_t ev;
-	int     sym;
-} event_map_t;
-
 typedef enum {
 	WM_PROTO, WM_FOCUS, WM_DELETE,
-	NET_STATE, NET_FULL, NET_STRUT,
+	NET_STATE, NET_FULL, NET_STRUT, NET_PARTIAL,
 	NET_TYPE, NET_DIALOG,
 	NATOMS
 } atom_t;
 
+typedef struct {
+	Display      *dpy;
+	unsigned long serial;
+	Window        xid;
+} kill_t;
+
 typedef enum {
 	CLR_FOCUS, CLR_UNFOCUS, CLR_URGENT, NCOLORS
 } color_t;
@@ -63,48 +62,42 @@ typedef enum {
 /* Global data */
 static win_t *root;
 static win_t *last;
+static Time   last_time;
 static int   running;
-static void *cache;
+static volatile sig_atomic_t dump;
 static Atom atoms[NATOMS];
 static int (*xerrorxlib)(Display *, XErrorEvent *);
 static unsigned long colors[NCOLORS];
-static list_t *screens;
-static list_t *struts;
-
-/* Debug functions */
-static char *state_map[] = {
-	[ST_HIDE ] "hide ",
-	[ST_SHOW ] "show ",
-	[ST_FULL ] "full ",
-	[ST_MAX  ] "max  ",
-	[ST_SHADE] "shade",
-	[ST_ICON ] "icon ",
-	[ST_CLOSE] "close",
-};
+static VECTOR(kill_t) kills;
 
 /* Conversion functions */
-static event_map_t ev2sym[] = {
-	{EV_LEFT    , XK_Left },
-	{EV_RIGHT   , XK_Right},
-	{EV_UP      , XK_Up   },
-	{EV_DOWN    , XK_Down },
-	{EV_HOME    , XK_Home },
-	{EV_END     , XK_End  },
-	{EV_PAGEUP  , XK_Prior},
-	{EV_PAGEDOWN, XK_Next },
-	{EV_F1      , XK_F1   },
-	{EV_F2      , XK_F2   },
-	{EV_F3      , XK_F3   },
-	{EV_F4      , XK_F4   },
-	{EV_F5      , XK_F5   },
-	{EV_F6      , XK_F6   },
-	{EV_F7      , XK_F7   },
-	{EV_F8      , XK_F8   },
-	{EV_F9      , XK_F9   },
-	{EV_F10     , XK_F10  },
-	{EV_F11     , XK_F11  },
-	{EV_F12     , XK_F12  },
-};
+#define KEYS(KEY)                 \
+	KEY(EV_LEFT    , XK_Left ) \
+	KEY(EV_RIGHT   , XK_Right) \
+	KEY(EV_UP      , XK_Up   ) \
+	KEY(EV_DOWN    , XK_Down ) \
+	KEY(EV_HOME    , XK_Home ) \
+	KEY(EV_END     , XK_End  ) \
+	KEY(EV_PAGEUP  , XK_Prior) \
+	KEY(EV_PAGEDOWN, XK_Next ) \
+	KEY(EV_F1      , XK_F1   ) \
+	KEY(EV_F2      , XK_F2   ) \
+	KEY(EV_F3      , XK_F3   ) \
+	KEY(EV_F4      , XK_F4   ) \
+	KEY(EV_F5      , XK_F5   ) \
+	KEY(EV_F6      , XK_F6   ) \
+	KEY(EV_F7      , XK_F7   ) \
+	KEY(EV_F8      , XK_F8   ) \
+	KEY(EV_F9      , XK_F9   ) \
+	KEY(EV_F10     , XK_F10  ) \
+	KEY(EV_F11     , XK_F11  ) \
+	KEY(EV_F12     , XK_F12  )
+
+/* All the keysyms above are in the 0xFF00 function key page */
+#define EV2SYM(ev, sym) [ev  - EV_LEFT] = sym,
+#define SYM2EV(ev, sym) [sym - 0xFF00 ] = ev,
+static KeySym  ev2sym[]      = { KEYS(EV2SYM) };
+static event_t sym2ev[0x100] = { KEYS(SYM2EV) };
 
 /* - Modifiers */
 static mod_t x2mod(unsigned int state, int up)
@@ -129,14 +122,12 @@ static unsigned int mod2x(mod_t mod)
 /* - Keycodes */
 static event_t xk2ev(KeySym sym)
 {
-	event_map_t *em = map_getr(ev2sym,sym);
-	return em ? em->ev : sym;
+	return map_get(sym2ev, 0xFF00, sym, sym);
 }
 
 static KeySym ev2xk(event_t ev)
 {
-	event_map_t *em = map_get(ev2sym,ev);
-	return em ? em->sym : ev;
+	return map_get(ev2sym, EV_LEFT, ev, ev);
 }
 
 static event_t xb2ev(int btn)
@@ -172,61 +163,90 @@ static Window getfocus(win_t *root, XEvent *xe)
 /* Strut functions
  *   Struts are spaces at the edges of the screen that are used by
  *   toolbars and statusbars such as dzen. */
-static int strut_copy(win_t *to, win_t *from, int scale)
-{
-	int left   = from->sys->strut.left;
-	int right  = from->sys->strut.right;
-	int top    = from->sys->strut.top;
-	int bottom = from->sys->strut.bottom;
-	if (left == 0 && right == 0 && top == 0 && bottom == 0)
-		return 0;
-	to->x += scale*(left      );
-	to->y += scale*(top       );
-	to->w -= scale*(left+right);
-	to->h -= scale*(top+bottom);
-	to->sys->strut.left   += scale*left;
-	to->sys->strut.right  += scale*right;
-	to->sys->strut.top    += scale*top;
-	to->sys->strut.bottom += scale*bottom;
-	return 1;
-}
-
-static int strut_add(win_t *root, win_t *win)
+static long *strut_get(win_t *win, atom_t prop, long n)
 {
-	/* Get X11 strut data */
 	Atom ret_type;
 	int ret_size;
 	unsigned long ret_items, bytes_left;
 	unsigned char *xdata;
-	int status = XGetWindowProperty(win->sys->dpy, win->sys->xid,
-			atoms[NET_STRUT], 0L, 4L, False, XA_CARDINAL,
+	int status = XGetWindowProperty(win->sys->dpy, X11(win)->xid,
+			atoms[prop], 0L, n, False, XA_CARDINAL,
 			&ret_type, &ret_size, &ret_items, &bytes_left, &xdata);
-	if (status != Success || ret_size != 32 || ret_items != 4)
-		return 0;
+	if (status != Success)
+		return NULL;
+	if (ret_size != 32 || ret_items != n)
+		return XFree(xdata), NULL;
+	return (long*)xdata;
+}
+
+static int strut_add(win_t *win)
+{
+	/* Get X11 strut data, prefer _NET_WM_STRUT_PARTIAL */
+	long *xdata;
+	strut_t strut = {};
+	if ((xdata = strut_get(win, NET_PARTIAL, 12)))
+		strut = (strut_t){
+			xdata[0], xdata[1], xdata[2],  xdata[3],
+			xdata[4], xdata[5], xdata[6],  xdata[7],
+			xdata[8], xdata[9], xdata[10], xdata[11],
+		};
+	else if ((xdata = strut_get(win, NET_STRUT, 4)))
+		strut = (strut_t){
+			xdata[0], xdata[1], xdata[2], xdata[3],
+		};
+	if (xdata)
+		XFree(xdata);
+	return x11_strut(win, &strut);
+}
+
+static void strut_del(win_t *win)
+{
+	x11_strut(win, NULL);
+}
+
+/* Kill functions
+ *   Clients that do not support WM_DELETE_WINDOW are killed
+ *   without grabbing the server. The request serial is saved
+ *   so the error from a client that is already gone can be
+ *   matched and ignored whenever it arrives. */
+static void kill_add(win_t *win)
+{
+	XSetCloseDownMode(win->sys->dpy, DestroyAll);
+	kill_t *kill = vec_push(&kills, (kill_t){});
+	kill->dpy    = win->sys->dpy;
+	kill->serial = NextRequest(win->sys->dpy);
+	kill->xid    = X11(win)->xid;
+	XKillClient(win->sys->dpy, X11(win)->xid);
+	XFlush(win->sys->dpy);
+}
 
-	win->sys->strut.left   = ((long*)xdata)[0];
-	win->sys->strut.right  = ((long*)xdata)[1];
-	win->sys->strut.top    = ((long*)xdata)[2];
-	win->sys->strut.bottom = ((long*)xdata)[3];
-	struts = list_insert(struts, win);
-	for (list_t *cur = screens; cur; cur = cur->next)
-		strut_copy(cur->data, win, 1);
-	return strut_copy(root, win, 1);
+static int kill_error(XErrorEvent *err)
+{
+	for (int i = 0; i < kills.length; i++) {
+		kill_t *kill = &kills.items[i];
+		if (kill->dpy == err->display && kill->serial == err->serial) {
+			trace(LOG_SYS, "kill_error: %lx - %d\n", kill->xid, err->error_code);
+			vec_del(&kills, i);
+			return 1;
+		}
+	}
+	return 0;
 }
 
-static int strut_del(win_t *root, win_t *win)
+static void kill_done(Display *dpy)
 {
-	list_t *lwin = list_find(struts, win);
-	if (lwin)
-		struts = list_remove(struts, lwin, 0);
-	for (list_t *cur = screens; cur; cur = cur->next)
-		strut_copy(cur->data, win, -1);
-	return strut_copy(root, win, -1);
+	unsigned long done = LastKnownRequestProcessed(dpy);
+	for (int i = kills.length-1; i >= 0; i--) {
+		kill_t *kill = &kills.items[i];
+		if (kill->dpy == dpy && (long)(done - kill->serial) >= 0)
+			vec_del(&kills, i);
+	}
 }
 
 /* Window functions */
 static Atom win_prop(win_t *win, atom_t prop);
 static win_t *win_find(Display *dpy, Window xid, int create);
+static void win_protos(win_t *win);
 
 static win_t *win_new(Display *dpy, Window xid)
 {
@@ -243,10 +263,10 @@ static win_t *win_new(Display *dpy, Window xid)
 	win->h        = attr.height;
 	win->sys      = new0(win_sys_t);
 	win->sys->dpy = dpy;
-	win->sys->xid = xid;
+	X11(win)->xid = xid;
 
 	if (root) {
-		if (strut_add(root, win))
+		if (strut_add(win))
 			win->type = TYPE_TOOLBAR;
 
 		if (win_prop(win, NET_TYPE) == atoms[NET_DIALOG])
@@ -258,10 +278,12 @@ static win_t *win_new(Display *dpy, Window xid)
 		if (XGetTransientForHint(dpy, xid, &trans))
 			win->parent = win_find(dpy, trans, 0);
 
+		win_protos(win);
+
 		XSelectInput(dpy, xid, PropertyChangeMask);
 	}
 
-	printf("win_new: win=%p x11=(%p,%d) state=%x pos=(%d,%d %dx%d) type=%s\n",
+	trace(LOG_SYS, "win_new: win=%p x11=(%p,%d) state=%x pos=(%d,%d %dx%d) type=%s\n",
 			win, dpy, (int)xid, win->state,
 			win->x, win->y, win->w, win->h,
 			win->type == TYPE_NORMAL  ? "normal"  :
@@ -274,29 +296,15 @@ static win_t *win_new(Display *dpy, Window xid)
 	return win;
 }
 
-static int win_cmp(const void *_a, const void *_b)
-{
-	const win_t *a = _a, *b = _b;
-	if (a->sys->dpy < b->sys->dpy) return -1;
-	if (a->sys->dpy > b->sys->dpy) return  1;
-	if (a->sys->xid < b->sys->xid) return -1;
-	if (a->sys->xid > b->sys->xid) return  1;
-	return 0;
-}
-
 static win_t *win_find(Display *dpy, Window xid, int create)
 {
 	if (!dpy || !xid)
 		return NULL;
 	//printf("win_find: %p, %d\n", dpy, (int)xid);
-	win_sys_t sys = {.dpy=dpy, .xid=xid};
-	win_t     tmp = {.sys=&sys};
-	win_t **old = NULL, *new = NULL;
-	if ((old = tfind(&tmp, &cache, win_cmp)))
-		return *old;
-	if (create && (new = win_new(dpy,xid)))
-		tsearch(new, &cache, win_cmp);
-	return new;
+	win_t *win = x11_win_find(xid);
+	if (!win && create && (win = win_new(dpy,xid)))
+		x11_win_add(win);
+	return win;
 }
 
 static void win_free(win_t *win)
@@ -310,10 +318,10 @@ static void win_free(win_t *win)
 static void win_remove(win_t *win)
 {
 	if (win != root) {
-		strut_del(root, win);
+		strut_del(win);
 		wm_remove(win);
 	}
-	tdelete(win, &cache, win_cmp);
+	x11_win_del(win);
 	win_free(win);
 }
 
@@ -326,26 +334,36 @@ static int win_viewable(Display *dpy, Window xid)
 		return True;
 }
 
-static int win_msg(win_t *win, atom_t msg)
+static void win_protos(win_t *win)
 {
-	int n, found = 0;
+	int n;
 	Atom *protos;
-	if (!XGetWMProtocols(win->sys->dpy, win->sys->xid, &protos, &n))
-		return 0;
-
-	while (!found && n--)
-		found = protos[n] == atoms[msg];
+	X11(win)->protos = 0;
+	if (!XGetWMProtocols(win->sys->dpy, X11(win)->xid, &protos, &n))
+		return;
+	while (n--) {
+		if (protos[n] == atoms[WM_DELETE])
+			X11(win)->protos |= PROTO_DELETE;
+		if (protos[n] == atoms[WM_FOCUS])
+			X11(win)->protos |= PROTO_FOCUS;
+	}
 	XFree(protos);
-	if (!found)
+}
+
+static int win_msg(win_t *win, atom_t msg)
+{
+	proto_t proto = msg == WM_DELETE ? PROTO_DELETE :
+	                msg == WM_FOCUS  ? PROTO_FOCUS  : 0;
+	if (!(X11(win)->protos & proto))
 		return 0;
 
-	XSendEvent(win->sys->dpy, win->sys->xid, False, NoEventMask, &(XEvent){
+	XSendEvent(win->sys->dpy, X11(win)->xid, False, NoEventMask, &(XEvent){
 		.xclient.type         = ClientMessage,
-		.xclient.window       = win->sys->xid,
+		.xclient.window       = X11(win)->xid,
 		.xclient.message_type = atoms[WM_PROTO],
 		.xclient.format       = 32,
 		.xclient.data.l[0]    = atoms[msg],
-		.xclient.data.l[1]    = CurrentTime,
+		.xclient.data.l[1]    = last_time,
 	});
 	return 1;
 }
@@ -356,7 +374,7 @@ static Atom win_prop(win_t *win, atom_t prop)
 	unsigned long nitems, bytes;
 	unsigned char *buf = NULL;
 	Atom atom, type = XA_ATOM;
-	if (XGetWindowProperty(win->sys->dpy, win->sys->xid, atoms[prop],
+	if (XGetWindowProperty(win->sys->dpy, X11(win)->xid, atoms[prop],
 			0L, sizeof(Atom), False, type, &type, &format, &nitems, &bytes, &buf) || !buf)
 		return 0;
 	atom = *(Atom *)buf;
@@ -375,143 +393,276 @@ static unsigned long get_color(Display *dpy, const char *name)
 }
 
 /* Callbacks */
-static void process_event(int type, XEvent *xe, win_t *root)
+static win_t *get_input(win_t *root, XEvent *xe, ptr_t *ptr, mod_t *mod, int up)
 {
-	Display  *dpy = root->sys->dpy;
-	win_t *win = NULL;
-	//printf("event: %d\n", type);
+	Window xid = getfocus(root, xe);
+	win_t *win = win_find(root->sys->dpy, xid, 0);
+	*ptr = x2ptr(xe);
+	*mod = x2mod(xe->xkey.state, up);
+	return win;
+}
 
-	/* Common data for all these events ... */
-	ptr_t ptr = {}; mod_t mod = {};
-	if (type == KeyPress    || type == KeyRelease    ||
-	    type == ButtonPress || type == ButtonRelease ||
-	    type == MotionNotify) {
-		Window xid = getfocus(root, xe);
-		if (!(win = win_find(dpy,xid,0)))
-			return;
-		//printf("button-press %p\n", win);
-		ptr = x2ptr(xe);
-		mod = x2mod(xe->xkey.state, type==KeyRelease||type==ButtonRelease);
-	}
+static void on_key_press(win_t *root, XEvent *xe)
+{
+	ptr_t ptr; mod_t mod;
+	win_t *win = get_input(root, xe, &ptr, &mod, 0);
+	if (!win) return;
+	while (XCheckTypedEvent(root->sys->dpy, KeyPress, xe));
+	KeySym sym = XLookupKeysym(&xe->xkey, 0);
+	//printf("got xe %c %hhx\n", xk2ev(sym), mod2int(mod));
+	wm_handle_event(win, xk2ev(sym), mod, ptr);
+}
 
-	/* Split based on event */
-	if (type == KeyPress) {
-		while (XCheckTypedEvent(dpy, KeyPress, xe));
-		KeySym sym = XLookupKeysym(&xe->xkey, 0);
-		//printf("got xe %c %hhx\n", xk2ev(sym), mod2int(mod));
-		wm_handle_event(win, xk2ev(sym), mod, ptr);
-	}
-	else if (type == KeyRelease) {
-		//printf("release: %lx\n", xe->xkey.window);
-	}
-	else if (type == ButtonPress) {
-		if (wm_handle_event(win, xb2ev(xe->xbutton.button), mod, ptr)) {
-			//printf("grab pointer\n");
-			XGrabPointer(dpy, xe->xbutton.root, True, PointerMotionMask|ButtonReleaseMask,
-					GrabModeAsync, GrabModeAsync, None, None, CurrentTime);
-		} else {
-			//printf("allow events\n");
-			XAllowEvents(win->sys->dpy, ReplayPointer, xe->xbutton.time);
-		}
-	}
-	else if (type == ButtonRelease) {
-		XUngrabPointer(dpy, CurrentTime);
-		wm_handle_event(win, xb2ev(xe->xbutton.button), mod, ptr);
-	}
-	else if (type == MotionNotify) {
-		while (XCheckTypedEvent(dpy, MotionNotify, xe));
-		wm_handle_ptr(win, ptr);
-	}
-	else if (type == EnterNotify || type == LeaveNotify) {
-		printf("%s: %lx\n", type==EnterNotify?"enter":"leave",
-				xe->xcrossing.window);
-		event_t ev = type == EnterNotify ? EV_ENTER : EV_LEAVE;
-		if ((win = win_find(dpy,xe->xcrossing.window,0)))
-			wm_handle_event(win, ev, MOD(), PTR());
-	}
-	else if (type == FocusIn || type == FocusOut) {
-		//printf("focus: %lx\n", xe->xfocus.window);
-		event_t ev = type == FocusIn ? EV_FOCUS : EV_UNFOCUS;
-		if ((win = win_find(dpy,xe->xfocus.window,0)))
-			wm_handle_event(win, ev, MOD(), PTR());
-	}
-	else if (type == ConfigureNotify) {
-		//printf("configure: %lx\n", xe->xconfigure.window);
-	}
-	else if (type == MapNotify) {
-		printf("map: %lx\n", xe->xmap.window);
-	}
-	else if (type == UnmapNotify) {
-		if ((win = win_find(dpy,xe->xunmap.window,0)) &&
-		     win->state != ST_HIDE) {
-			printf("unmap: %lx\n", xe->xunmap.window);
-			wm_handle_state(win, win->state, ST_HIDE);
-			win->state = ST_HIDE;
-		}
+static void on_key_release(win_t *root, XEvent *xe)
+{
+	//printf("release: %lx\n", xe->xkey.window);
+}
+
+static void on_button_press(win_t *root, XEvent *xe)
+{
+	ptr_t ptr; mod_t mod;
+	win_t *win = get_input(root, xe, &ptr, &mod, 0);
+	if (!win) return;
+	if (wm_handle_event(win, xb2ev(xe->xbutton.button), mod, ptr)) {
+		//printf("grab pointer\n");
+		XGrabPointer(win->sys->dpy, xe->xbutton.root, True, PointerMotionMask|ButtonReleaseMask,
+				GrabModeAsync, GrabModeAsync, None, None, CurrentTime);
+	} else {
+		//printf("allow events\n");
+		XAllowEvents(win->sys->dpy, ReplayPointer, xe->xbutton.time);
 	}
-	else if (type == DestroyNotify) {
-		printf("destroy: %lx\n", xe->xdestroywindow.window);
-		if ((win = win_find(dpy,xe->xdestroywindow.window,0)))
-			win_remove(win);
+}
+
+static void on_button_release(win_t *root, XEvent *xe)
+{
+	ptr_t ptr; mod_t mod;
+	win_t *win = get_input(root, xe, &ptr, &mod, 1);
+	if (!win) return;
+	XUngrabPointer(win->sys->dpy, CurrentTime);
+	wm_handle_event(win, xb2ev(xe->xbutton.button), mod, ptr);
+}
+
+static void on_motion_notify(win_t *root, XEvent *xe)
+{
+	ptr_t ptr; mod_t mod;
+	win_t *win = get_input(root, xe, &ptr, &mod, 0);
+	if (!win) return;
+	while (XCheckTypedEvent(root->sys->dpy, MotionNotify, xe));
+	wm_handle_ptr(win, ptr);
+}
+
+static void on_crossing(win_t *root, XEvent *xe)
+{
+	win_t *win;
+	trace(LOG_EVENT, "%s: %lx\n", xe->type==EnterNotify?"enter":"leave",
+			xe->xcrossing.window);
+	event_t ev = xe->type == EnterNotify ? EV_ENTER : EV_LEAVE;
+	if ((win = win_find(root->sys->dpy,xe->xcrossing.window,0)))
+		wm_handle_event(win, ev, MOD(), PTR());
+}
+
+static void on_focus(win_t *root, XEvent *xe)
+{
+	win_t *win;
+	//printf("focus: %lx\n", xe->xfocus.window);
+	event_t ev = xe->type == FocusIn ? EV_FOCUS : EV_UNFOCUS;
+	if ((win = win_find(root->sys->dpy,xe->xfocus.window,0)))
+		wm_handle_event(win, ev, MOD(), PTR());
+}
+
+static void on_configure_notify(win_t *root, XEvent *xe)
+{
+	//printf("configure: %lx\n", xe->xconfigure.window);
+}
+
+static void on_map_notify(win_t *root, XEvent *xe)
+{
+	trace(LOG_EVENT, "map: %lx\n", xe->xmap.window);
+}
+
+static void on_unmap_notify(win_t *root, XEvent *xe)
+{
+	win_t *win;
+	if ((win = win_find(root->sys->dpy,xe->xunmap.window,0)) &&
+	     win->state != ST_HIDE) {
+		trace(LOG_EVENT, "unmap: %lx\n", xe->xunmap.window);
+		wm_handle_state(win, win->state, ST_HIDE);
+		win->state = ST_HIDE;
 	}
-	else if (type == ConfigureRequest) {
-		XConfigureRequestEvent *cre = &xe->xconfigurerequest;
-		printf("configure_req: %lx - (0x%lx) %dx%d @ %d,%d\n",
-				cre->window, cre->value_mask,
-				cre->height, cre->width, cre->x, cre->y);
-		if ((win = win_find(dpy,cre->window,1))) {
-			int border_width = (win->type == TYPE_TOOLBAR ? 0 : border);
-			XSendEvent(dpy, cre->window, False, StructureNotifyMask, &(XEvent){
-				.xconfigure.type         = ConfigureNotify,
-				.xconfigure.display      = win->sys->dpy,
-				.xconfigure.event        = win->sys->xid,
-				.xconfigure.window       = win->sys->xid,
-				.xconfigure.x            = win->x,
-				.xconfigure.y            = win->y,
-				.xconfigure.width        = win->w,
-				.xconfigure.height       = win->h,
-				.xconfigure.border_width = border_width,
-			});
-			XSync(win->sys->dpy, False);
-		}
+}
+
+static void on_destroy_notify(win_t *root, XEvent *xe)
+{
+	win_t *win;
+	trace(LOG_EVENT, "destroy: %lx\n", xe->xdestroywindow.window);
+	if ((win = win_find(root->sys->dpy,xe->xdestroywindow.window,0)))
+		win_remove(win);
+}
+
+static void on_configure_request(win_t *root, XEvent *xe)
+{
+	win_t *win;
+	XConfigureRequestEvent *cre = &xe->xconfigurerequest;
+	trace(LOG_EVENT, "configure_req: %lx - (0x%lx) %dx%d @ %d,%d\n",
+			cre->window, cre->value_mask,
+			cre->height, cre->width, cre->x, cre->y);
+	if ((win = win_find(root->sys->dpy,cre->window,1))) {
+		int border_width = (win->type == TYPE_TOOLBAR ? 0 : border);
+		XSendEvent(win->sys->dpy, cre->window, False, StructureNotifyMask, &(XEvent){
+			.xconfigure.type         = ConfigureNotify,
+			.xconfigure.display      = win->sys->dpy,
+			.xconfigure.event        = X11(win)->xid,
+			.xconfigure.window       = X11(win)->xid,
+			.xconfigure.x            = win->x,
+			.xconfigure.y            = win->y,
+			.xconfigure.width        = win->w,
+			.xconfigure.height       = win->h,
+			.xconfigure.border_width = border_width,
+		});
 	}
-	else if (type == MapRequest) {
-		printf("map_req: %lx\n", xe->xmaprequest.window);
-		win = win_find(dpy,xe->xmaprequest.window,1);
-		// fixme, for hide -> max, etc
-		if (win->state == ST_HIDE) {
-			wm_handle_state(win, win->state, ST_SHOW);
-			win->state = ST_SHOW;
-		}
-		sys_show(win, win->state);
+}
+
+static void on_map_request(win_t *root, XEvent *xe)
+{
+	win_t *win;
+	trace(LOG_EVENT, "map_req: %lx\n", xe->xmaprequest.window);
+	if (!(win = win_find(root->sys->dpy,xe->xmaprequest.window,1)))
+		return;
+	// fixme, for hide -> max, etc
+	if (win->state == ST_HIDE) {
+		wm_handle_state(win, win->state, ST_SHOW);
+		win->state = ST_SHOW;
 	}
-	else if (type == ClientMessage) {
-		XClientMessageEvent *cme = &xe->xclient;
-		printf("client_msg: %lx - %ld %ld,%ld,%ld,%ld,%ld\n",
-				cme->window, cme->message_type,
-				cme->data.l[0], cme->data.l[1], cme->data.l[2],
-				cme->data.l[3], cme->data.l[4]);
-		if ((win = win_find(dpy,cme->window,0))     &&
-		    (cme->message_type == atoms[NET_STATE]) &&
-		    (cme->data.l[1] == atoms[NET_FULL] ||
-		     cme->data.l[2] == atoms[NET_FULL])) {
-			state_t next = (cme->data.l[0] == 1 || /* _NET_WM_STATE_ADD    */
-			               (cme->data.l[0] == 2 && /* _NET_WM_STATE_TOGGLE */
-			                win->state != ST_FULL)) ? ST_FULL : ST_SHOW;
-			wm_handle_state(win, win->state, next);
-			sys_show(win, next);
-		}
+	sys_show(win, win->state);
+}
+
+static void on_client_message(win_t *root, XEvent *xe)
+{
+	win_t *win;
+	XClientMessageEvent *cme = &xe->xclient;
+	trace(LOG_EVENT, "client_msg: %lx - %ld %ld,%ld,%ld,%ld,%ld\n",
+			cme->window, cme->message_type,
+			cme->data.l[0], cme->data.l[1], cme->data.l[2],
+			cme->data.l[3], cme->data.l[4]);
+	if ((win = win_find(root->sys->dpy,cme->window,0)) &&
+	    (cme->message_type == atoms[NET_STATE]) &&
+	    (cme->data.l[1] == atoms[NET_FULL] ||
+	     cme->data.l[2] == atoms[NET_FULL])) {
+		state_t next = (cme->data.l[0] == 1 || /* _NET_WM_STATE_ADD    */
+		               (cme->data.l[0] == 2 && /* _NET_WM_STATE_TOGGLE */
+		                win->state != ST_FULL)) ? ST_FULL : ST_SHOW;
+		wm_handle_state(win, win->state, next);
+		sys_show(win, next);
 	}
-	else if (type == PropertyNotify) {
-		printf("prop: %lx - %d\n", xe->xproperty.window, xe->xproperty.state);
+}
+
+static void on_property_notify(win_t *root, XEvent *xe)
+{
+	win_t *win;
+	trace(LOG_EVENT, "prop: %lx - %d\n", xe->xproperty.window, xe->xproperty.state);
+	if (!(win = win_find(root->sys->dpy,xe->xproperty.window,0)))
+		return;
+	if (xe->xproperty.atom == atoms[WM_PROTO])
+		win_protos(win);
+	if ((xe->xproperty.atom == atoms[NET_STRUT] ||
+	     xe->xproperty.atom == atoms[NET_PARTIAL]) && strut_add(win))
+		win->type = TYPE_TOOLBAR;
+}
+
+static void on_unknown(win_t *root, XEvent *xe)
+{
+	trace(LOG_EVENT, "unknown event: %d\n", xe->type);
+}
+
+/* Event dispatch
+ *   Handlers are indexed by event type, the time spent in
+ *   each handler is recorded so that it can be dumped with
+ *   SIGUSR1 to see where the main loop spends it's time,
+ *   debug builds also dump it on exit */
+static struct {
+	char *name;
+	void (*func)(win_t *root, XEvent *xe);
+} handlers[LASTEvent] = {
+	[KeyPress        ] {"KeyPress",         on_key_press        },
+	[KeyRelease      ] {"KeyRelease",       on_key_release      },
+	[ButtonPress     ] {"ButtonPress",      on_button_press     },
+	[ButtonRelease   ] {"ButtonRelease",    on_button_release   },
+	[MotionNotify    ] {"MotionNotify",     on_motion_notify    },
+	[EnterNotify     ] {"EnterNotify",      on_crossing         },
+	[LeaveNotify     ] {"LeaveNotify",      on_crossing         },
+	[FocusIn         ] {"FocusIn",          on_focus            },
+	[FocusOut        ] {"FocusOut",         on_focus            },
+	[ConfigureNotify ] {"ConfigureNotify",  on_configure_notify },
+	[MapNotify       ] {"MapNotify",        on_map_notify       },
+	[UnmapNotify     ] {"UnmapNotify",      on_unmap_notify     },
+	[DestroyNotify   ] {"DestroyNotify",    on_destroy_notify   },
+	[ConfigureRequest] {"ConfigureRequest", on_configure_request},
+	[MapRequest      ] {"MapRequest",       on_map_request      },
+	[ClientMessage   ] {"ClientMessage",    on_client_message   },
+	[PropertyNotify  ] {"PropertyNotify",   on_property_notify  },
+};
+
+static struct {
+	unsigned long count;
+	long long     time;
+} profile[LASTEvent];
+
+/* Timestamp of the event, or CurrentTime for events without one */
+static Time event_time(XEvent *xe)
+{
+	switch (xe->type) {
+	case KeyPress:
+	case KeyRelease:     return xe->xkey.time;
+	case ButtonPress:
+	case ButtonRelease:  return xe->xbutton.time;
+	case MotionNotify:   return xe->xmotion.time;
+	case EnterNotify:
+	case LeaveNotify:    return xe->xcrossing.time;
+	case PropertyNotify: return xe->xproperty.time;
+	default:             return CurrentTime;
 	}
-	else {
-		printf("unknown event: %d\n", type);
+}
+
+static void process_event(win_t *root, XEvent *xe)
+{
+	int type = xe->type;
+	if (type < 0 || type >= LASTEvent)
+		return on_unknown(root, xe);
+	if (event_time(xe) != CurrentTime)
+		last_time = event_time(xe);
+	//printf("event: %d\n", type);
+	ring_put(RING_EVENT, xe->xany.window, type, 0, 0, 0);
+	long long start = get_nsec();
+	(handlers[type].func ?: on_unknown)(root, xe);
+	profile[type].time += get_nsec() - start;
+	profile[type].count++;
+}
+
+static void profile_dump(void)
+{
+	printf("profile: %-16s %8s %12s %10s\n",
+			"event", "count", "total(us)", "avg(us)");
+	for (int i = 0; i < LASTEvent; i++) {
+		if (!profile[i].count)
+			continue;
+		printf("profile: %-16s %8lu %12.1f %10.2f\n",
+				handlers[i].name ?: "unknown",
+				profile[i].count,
+				profile[i].time / 1E3,
+				profile[i].time / 1E3 / profile[i].count);
 	}
+	fflush(stdout);
+}
+
+static void on_sigusr1(int signum)
+{
+	dump = 1;
 }
 
 static int xerror(Display *dpy, XErrorEvent *err)
 {
+	if (kill_error(err))
+		return 0;
 	if (err->error_code == BadWindow ||
 	    (err->request_code == X_SetInputFocus     && err->error_code == BadMatch   ) ||
 	    (err->request_code == X_PolyText8         && err->error_code == BadDrawable) ||
@@ -527,11 +678,6 @@ static int xerror(Display *dpy, XErrorEvent *err)
 	return xerrorxlib(dpy, err);
 }
 
-static int xnoerror(Display *dpy, XErrorEvent *err)
-{
-	return 0;
-}
-
 
 /********************
  * System functions *
@@ -539,45 +685,42 @@ static int xnoerror(Display *dpy, XErrorEvent *err)
 void sys_move(win_t *win, int x, int y, int w, int h)
 {
 	//printf("sys_move: %p - %d,%d  %dx%d\n", win, x, y, w, h);
-	int b = 2*border;
-	win->x = x; win->y = y;
-	win->w = MAX(w,1+b); win->h = MAX(h,1+b);
-	w      = MAX(w-b,1); h      = MAX(h-b,1);
-	XConfigureWindow(win->sys->dpy, win->sys->xid, CWX|CWY|CWWidth|CWHeight,
-		&(XWindowChanges) { .x=x, .y=y, .width=w, .height=h });
-	XMoveResizeWindow(win->sys->dpy, win->sys->xid, x, y, w, h);
-
-	/* Flush events, so moving window doesn't cause re-focus
-	 * There's probably a better way to do this */
-	XEvent xe;
-	XSync(win->sys->dpy, False);
-	while (XCheckMaskEvent(win->sys->dpy, EnterWindowMask|LeaveWindowMask, &xe))
-		printf("Skipping enter/leave event\n");
+	ring_put(RING_MOVE, X11(win)->xid, x, y, w, h);
+	if (!x11_move(win, x, y, w, h, border))
+		return;
+	geom_t *geom = &X11(win)->geom;
+	XConfigureWindow(win->sys->dpy, X11(win)->xid, CWX|CWY|CWWidth|CWHeight,
+		&(XWindowChanges) { .x=geom->x, .y=geom->y,
+		                    .width=geom->w, .height=geom->h });
 }
 
 void sys_raise(win_t *win)
 {
 	//printf("sys_raise: %p\n", win);
-	XRaiseWindow(win->sys->dpy, win->sys->xid);
-	for (list_t *cur = struts; cur; cur = cur->next)
+	ring_put(RING_RAISE, X11(win)->xid, 0, 0, 0, 0);
+	XRaiseWindow(win->sys->dpy, X11(win)->xid);
+	for (list_t *cur = x11_struts(); cur; cur = cur->next)
 		XRaiseWindow(((win_t*)cur->data)->sys->dpy,
-		             ((win_t*)cur->data)->sys->xid);
+		             X11((win_t*)cur->data)->xid);
 }
 
 void sys_focus(win_t *win)
 {
 	//printf("sys_focus: %p\n", win);
+	ring_put(RING_FOCUS, win ? X11(win)->xid : 0, 0, 0, 0, 0);
 
-	/* Set actual focus */
-	XSetInputFocus(win->sys->dpy, win->sys->xid,
+	/* Set actual focus, the root window when none */
+	win_t *focus = win ?: root;
+	XSetInputFocus(focus->sys->dpy, X11(focus)->xid,
 			RevertToPointerRoot, CurrentTime);
-	//win_msg(win, WM_FOCUS);
+	if (win)
+		win_msg(win, WM_FOCUS);
 
 	/* Set border on focused window */
 	if (last)
-		XSetWindowBorder(last->sys->dpy, last->sys->xid, colors[CLR_UNFOCUS]);
-	XSync(win->sys->dpy, False);
-	XSetWindowBorder(win->sys->dpy, win->sys->xid, colors[CLR_FOCUS]);
+		XSetWindowBorder(last->sys->dpy, X11(last)->xid, colors[CLR_UNFOCUS]);
+	if (win)
+		XSetWindowBorder(win->sys->dpy, X11(win)->xid, colors[CLR_FOCUS]);
 	last = win;
 }
 
@@ -585,78 +728,65 @@ void sys_show(win_t *win, state_t state)
 {
 	//if (win->state == state)
 	//	return;
+	ring_put(RING_SHOW, X11(win)->xid, state, 0, 0, 0);
 
 	/* Debug */
-	printf("sys_show: %p: %s -> %s\n", win,
-			state_map[win->state], state_map[state]);
+	trace(LOG_SYS, "sys_show: %p: %s -> %s\n", win,
+			x11_state(win->state), x11_state(state));
 
 	/* Find screen */
-	win_t *screen = NULL;
-	if (state == ST_FULL || state == ST_MAX) {
-		for (list_t *cur = screens; cur; cur = cur->next) {
-			screen = cur->data;
-			if (win->x >= screen->x && win->x <= screen->x+screen->w &&
-			    win->y >= screen->y && win->y <= screen->y+screen->h)
-				break;
-		}
-	}
+	geom_t max, full;
+	if (state == ST_FULL || state == ST_MAX)
+		x11_area(win, &max, &full);
 
 	/* Update properties */
 	if (state == ST_FULL)
-		XChangeProperty(win->sys->dpy, win->sys->xid, atoms[NET_STATE], XA_ATOM, 32,
+		XChangeProperty(win->sys->dpy, X11(win)->xid, atoms[NET_STATE], XA_ATOM, 32,
 		                PropModeReplace, (unsigned char*)&atoms[NET_FULL], 1);
 	else if (state != ST_FULL)
-		XChangeProperty(win->sys->dpy, win->sys->xid, atoms[NET_STATE], XA_ATOM, 32,
+		XChangeProperty(win->sys->dpy, X11(win)->xid, atoms[NET_STATE], XA_ATOM, 32,
 				PropModeReplace, (unsigned char*)0, 0);
 
 	/* Update border */
 	if (win->type == TYPE_TOOLBAR || state == ST_FULL)
-		XSetWindowBorderWidth(win->sys->dpy, win->sys->xid, 0);
+		XSetWindowBorderWidth(win->sys->dpy, X11(win)->xid, 0);
 	else if (state == ST_SHOW || state == ST_MAX || state == ST_SHADE)
-		XSetWindowBorderWidth(win->sys->dpy, win->sys->xid, border);
+		XSetWindowBorderWidth(win->sys->dpy, X11(win)->xid, border);
 
-	/* Map/Unmap window */
-	if (state == ST_SHOW || state == ST_FULL || state == ST_MAX || state == ST_SHADE)
-		XMapWindow(win->sys->dpy, win->sys->xid);
-	else if (state == ST_HIDE)
-		XUnmapWindow(win->sys->dpy, win->sys->xid);
+	/* Unmap window */
+	if (state == ST_HIDE)
+		XUnmapWindow(win->sys->dpy, X11(win)->xid);
 
 	/* Resize windows */
 	if (state == ST_SHOW) {
 		sys_move(win, win->x, win->y, win->w, win->h);
 	} else if (state == ST_MAX) {
-		sys_move(win, screen->x, screen->y, screen->w, screen->h);
+		sys_move(win, max.x, max.y, max.w, max.h);
 	} else if (state == ST_FULL) {
-		XWindowChanges wc = {
-			.x      = screen->x - screen->sys->strut.left ,
-			.y      = screen->y - screen->sys->strut.top ,
-			.width  = screen->w + screen->sys->strut.left + screen->sys->strut.right,
-			.height = screen->h + screen->sys->strut.top  + screen->sys->strut.bottom
-		};
-		win->x = wc.x;     win->y = wc.y;
-		win->w = wc.width; win->h = wc.height;
-		XConfigureWindow(win->sys->dpy, win->sys->xid, CWX|CWY|CWWidth|CWHeight, &wc);
-		XMoveResizeWindow(win->sys->dpy, win->sys->xid, wc.x, wc.y, wc.width, wc.height);
+		win->x = full.x; win->y = full.y;
+		win->w = full.w; win->h = full.h;
+		if (x11_geom(win, full.x, full.y, full.w, full.h, -1))
+			XConfigureWindow(win->sys->dpy, X11(win)->xid, CWX|CWY|CWWidth|CWHeight,
+				&(XWindowChanges) { .x=full.x, .y=full.y,
+				                    .width=full.w, .height=full.h });
 	} else if (state == ST_SHADE) {
-		XConfigureWindow(win->sys->dpy, win->sys->xid, CWHeight,
-			&(XWindowChanges) { .height = stack });
+		if (x11_geom(win, -1, -1, -1, stack, -1))
+			XConfigureWindow(win->sys->dpy, X11(win)->xid, CWHeight,
+				&(XWindowChanges) { .height = stack });
 	}
 
+	/* Map window, after resizing so it never appears at its old size */
+	if (state == ST_SHOW || state == ST_FULL || state == ST_MAX || state == ST_SHADE)
+		XMapWindow(win->sys->dpy, X11(win)->xid);
+
 	/* Raise window */
 	if (state == ST_FULL || state == ST_MAX)
-		XRaiseWindow(win->sys->dpy, win->sys->xid);
+		XRaiseWindow(win->sys->dpy, X11(win)->xid);
 
 	/* Close windows */
 	if (state == ST_CLOSE) {
-		if (!win_msg(win, WM_DELETE)) {
-			XGrabServer(win->sys->dpy);
-			XSetErrorHandler(xnoerror);
-			XSetCloseDownMode(win->sys->dpy, DestroyAll);
-			XKillClient(win->sys->dpy, win->sys->xid);
-			XSync(win->sys->dpy, False);
-			XSetErrorHandler(xerror);
-			XUngrabServer(win->sys->dpy);
-		}
+		if (!win_msg(win, WM_DELETE))
+			kill_add(win);
 	}
 
 	/* Update state */
@@ -669,21 +799,21 @@ void sys_watch(win_t *win, event_t ev, mod_t mod)
 	if (win == NULL)
 		win = root;
 	XWindowAttributes attr;
-	XGetWindowAttributes(win->sys->dpy, win->sys->xid, &attr);
+	XGetWindowAttributes(win->sys->dpy, X11(win)->xid, &attr);
 	long mask = attr.your_event_mask;
 	if (EV_MOUSE0 <= ev && ev <= EV_MOUSE7)
-		XGrabButton(win->sys->dpy, ev2xb(ev), mod2x(mod), win->sys->xid, False,
+		XGrabButton(win->sys->dpy, ev2xb(ev), mod2x(mod), X11(win)->xid, False,
 				mod.up ? ButtonReleaseMask : ButtonPressMask,
 				GrabModeSync, GrabModeAsync, None, None);
 	else if (ev == EV_ENTER)
-		XSelectInput(win->sys->dpy, win->sys->xid, EnterWindowMask|mask);
+		XSelectInput(win->sys->dpy, X11(win)->xid, EnterWindowMask|mask);
 	else if (ev == EV_LEAVE)
-		XSelectInput(win->sys->dpy, win->sys->xid, LeaveWindowMask|mask);
+		XSelectInput(win->sys->dpy, X11(win)->xid, LeaveWindowMask|mask);
 	else if (ev == EV_FOCUS || ev == EV_UNFOCUS)
-		XSelectInput(win->sys->dpy, win->sys->xid, FocusChangeMask|mask);
+		XSelectInput(win->sys->dpy, X11(win)->xid, FocusChangeMask|mask);
 	else
 		XGrabKey(win->sys->dpy, XKeysymToKeycode(win->sys->dpy, ev2xk(ev)),
-				mod2x(mod), win->sys->xid, True, GrabModeAsync, GrabModeAsync);
+				mod2x(mod), X11(win)->xid, True, GrabModeAsync, GrabModeAsync);
 }
 
 void sys_unwatch(win_t *win, event_t ev, mod_t mod)
@@ -691,35 +821,34 @@ void sys_unwatch(win_t *win, event_t ev, mod_t mod)
 	if (win == NULL)
 		win = root;
 	if (EV_MOUSE0 <= ev && ev <= EV_MOUSE7)
-		XUngrabButton(win->sys->dpy, ev2xb(ev), mod2x(mod), win->sys->xid);
+		XUngrabButton(win->sys->dpy, ev2xb(ev), mod2x(mod), X11(win)->xid);
+}
+
+void sys_timer(int msec)
+{
+	x11_timer(msec);
 }
 
 list_t *sys_info(void)
 {
 	/* Use global copy of screens so we can add struts */
-	if (screens == NULL) {
+	if (x11_screens() == NULL) {
 		/* Add Xinerama screens */
 		int n = 0;
 		XineramaScreenInfo *info = NULL;
 		if (XineramaIsActive(root->sys->dpy))
 			info = XineramaQueryScreens(root->sys->dpy, &n);
-		for (int i = 0; i < n; i++) {
-			win_t *screen = new0(win_t);
-			screen->x = info[i].x_org;
-			screen->y = info[i].y_org;
-			screen->w = info[i].width;
-			screen->h = info[i].height;
-			screen->sys = new0(win_sys_t);
-			screens = list_append(screens, screen);
-		}
+		for (int i = 0; i < n; i++)
+			x11_screen(info[i].x_org, info[i].y_org,
+			           info[i].width, info[i].height);
+		if (info)
+			XFree(info);
 	}
-	if (screens == NULL) {
+	if (x11_screens() == NULL) {
 		/* No xinerama support */
-		win_t *screen = new0(win_t);
-		*screen = *root;
-		screens = list_insert(NULL, screen);
+		x11_screen(root->x, root->y, root->w, root->h);
 	}
-	return screens;
+	return x11_screens();
 }
 
 void sys_init(void)
@@ -745,6 +874,7 @@ void sys_init(void)
 	atoms[NET_STATE]   = XInternAtom(dpy, "_NET_WM_STATE",              False);
 	atoms[NET_FULL]    = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN",   False);
 	atoms[NET_STRUT]   = XInternAtom(dpy, "_NET_WM_STRUT",              False);
+	atoms[NET_PARTIAL] = XInternAtom(dpy, "_NET_WM_STRUT_PARTIAL",      False);
 	atoms[NET_TYPE]    = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE",        False);
 	atoms[NET_DIALOG]  = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
 
@@ -756,6 +886,7 @@ void sys_init(void)
 	/* Select window management events */
 	XSelectInput(dpy, xid, SubstructureRedirectMask|SubstructureNotifyMask);
 	xerrorxlib = XSetErrorHandler(xerror);
+	signal(SIGUSR1, on_sigusr1);
 
 	root = win_find(dpy, xid, 1);
 }
@@ -766,13 +897,14 @@ void sys_run(void)
 	if (!no_capture) {
 		unsigned int nkids;
 		Window par, xid, *kids = NULL;
-		if (XQueryTree(root->sys->dpy, root->sys->xid,
+		if (XQueryTree(root->sys->dpy, X11(root)->xid,
 					&par, &xid, &kids, &nkids)) {
 			for(int i = 0; i < nkids; i++)
 				if (win_viewable(root->sys->dpy, kids[i]))
 					win_find(root->sys->dpy, kids[i], 1);
 			XFree(kids);
 		}
+		x11_need_sync();
 	}
 
 	/* Main loop */
@@ -780,8 +912,24 @@ void sys_run(void)
 	while (running)
 	{
 		XEvent xe;
-		XNextEvent(root->sys->dpy, &xe);
-		process_event(xe.type, &xe, root);
+		if (XPending(root->sys->dpy) ||
+		    x11_wait(ConnectionNumber(root->sys->dpy))) {
+			XNextEvent(root->sys->dpy, &xe);
+			process_event(root, &xe);
+		} else {
+			wm_handle_timer();
+		}
+		if (x11_need_sync()) {
+			/* Flush events, so moving window doesn't cause re-focus */
+			XSync(root->sys->dpy, False);
+			while (XCheckMaskEvent(root->sys->dpy,
+					EnterWindowMask|LeaveWindowMask, &xe))
+				trace(LOG_EVENT, "Skipping enter/leave event\n");
+		}
+		if (kills.length)
+			kill_done(root->sys->dpy);
+		if (dump)
+			profile_dump(), dump = 0;
 	}
 }
 
@@ -792,10 +940,9 @@ void sys_exit(void)
 
 void sys_free(void)
 {
+	if (logging(LOG_DEBUG, LOG_SYS))
+		profile_dump();
 	XCloseDisplay(root->sys->dpy);
-	while (screens) {
-		win_free(screens->data);
-		screens = list_remove(screens, screens, 0);
-	}
-	tdestroy(cache, (void(*)(void*))win_free);
+	vec_free(&kills);
+	x11_free(win_free);
 }
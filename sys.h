@@ -45,6 +45,10 @@ void sys_watch(win_t *win, event_t ev, mod_t mod);
 /* Stop watching an event */
 void sys_unwatch(win_t *win, event_t event, mod_t mod);
 
+/* Call wm_handle_timer once after msec milliseconds,
+ * this replaces any timer that is still pending. */
+void sys_timer(int msec);
+
 /* Return a list of windows representing the geometry of the
  * physical displays attached to the computer. */
 list_t *sys_info(void);
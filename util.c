@@ -16,13 +16,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
 
 #include "util.h"
 
+/* Logging categories enabled at run time */
+int log_mask = ~0;
+
 /* Doubly linked lists */
+__thread pool_t list_pool = SLAB(list_t, 64);
+
 list_t *list_insert(list_t *next, void *data)
 {
-	list_t *node = new0(list_t);
+	list_t *node = pool_get(&list_pool);
 	node->data = data;
 	node->next = next;
 	node->prev = next ? next->prev : NULL;
@@ -35,7 +45,7 @@ void list_insert_after(list_t *prev, void *data)
 {
 	// prev must be valid,
 	// as we cannot return the original list head
-	list_t *node = new0(list_t);
+	list_t *node = pool_get(&list_pool);
 	node->data = data;
 	node->prev = prev;
 	node->next = prev->next;
@@ -48,7 +58,7 @@ list_t *list_append(list_t *head, void *data)
 	list_t *last = head;
 	while (last && last->next)
 		last = last->next;
-	list_t *node = new0(list_t);
+	list_t *node = pool_get(&list_pool);
 	node->data = data;
 	node->prev = last;
 	if (last) last->next = node;
@@ -63,7 +73,7 @@ list_t *list_remove(list_t *head, list_t *node, int freedata)
 	if (prev) prev->next = next;
 	if (freedata)
 		free(node->data);
-	free(node);
+	pool_put(&list_pool, node);
 	return head == node ? next : head;
 }
 
@@ -90,48 +100,210 @@ list_t *list_find(list_t *list, void *data)
 	return NULL;
 }
 
-list_t *list_sort(list_t *list, int rev, int (*func)(void *a, void*b))
+static list_t *list_merge(list_t *a, list_t *b, int rev,
+		int (*func)(void *a, void *b))
 {
-	if (list == NULL || list->next == NULL)
-		return list;
+	// Merge two sorted runs through next, ties come from a
+	list_t *head = NULL, **tail = &head;
+	while (a && b) {
+		int cmp = rev ? func(b->data, a->data)
+		              : func(a->data, b->data);
+		list_t **min = cmp > 0 ? &b : &a;
+		*tail = *min;
+		tail  = &(*min)->next;
+		*min  = (*min)->next;
+	}
+	*tail = a ?: b;
+	return head;
+}
 
-	/* Split list */
-	list_t *sides[2] = {NULL, NULL};
-	for (int i = 0; list; i=(i+1)%2) {
-		list_t *head = list;
+list_t *list_sort(list_t *list, int rev, int (*func)(void *a, void*b))
+{
+	/* Bottom up merge sort, runs[i] holds 2^i items and
+	 * is always older than the runs below it */
+	list_t *runs[sizeof(long)*8] = {};
+	int     top = 0;
+	while (list) {
+		list_t *run = list;
 		list = list->next;
-		head->next = sides[i];
-		sides[i]   = head;
+		run->next = NULL;
+		int i;
+		for (i = 0; runs[i]; i++) {
+			run = list_merge(runs[i], run, rev, func);
+			runs[i] = NULL;
+		}
+		runs[i] = run;
+		top = MAX(top, i+1);
 	}
+	for (int i = 0; i < top; i++)
+		if (runs[i])
+			list = list ? list_merge(runs[i], list, rev, func) : runs[i];
 
-	/* Sort sides */
-	sides[0] = list_sort(sides[0], !rev, func);
-	sides[1] = list_sort(sides[1], !rev, func);
-
-	/* Merge sides */
-	while (sides[0] || sides[1]) {
-		int i = sides[0] == NULL ? 1 :
-		        sides[1] == NULL ? 0 :
-			func(sides[0]->data,
-			     sides[1]->data) > 0 ? !!rev : !rev;
-		list_t *head = sides[i];
-		sides[i] = sides[i]->next;
-		head->next = list;
-		head->prev = NULL;
-		if (list)
-			list->prev = head;
-		list = head;
-	}
+	/* Relink prev pointers */
+	for (list_t *cur = list, *prev = NULL; cur; prev = cur, cur = cur->next)
+		cur->prev = prev;
 	return list;
 }
 
+/* Intrusive lists */
+void chain_insert(chain_t *chain, link_t *next, link_t *link)
+{
+	// Insert before next, or at the end when next is NULL
+	link->next = next;
+	link->prev = next ? next->prev : chain->tail;
+	if (link->prev) link->prev->next = link;
+	else            chain->head      = link;
+	if (link->next) link->next->prev = link;
+	else            chain->tail      = link;
+	chain->length++;
+}
+
+void chain_append(chain_t *chain, link_t *link)
+{
+	chain_insert(chain, NULL, link);
+}
+
+void chain_remove(chain_t *chain, link_t *link)
+{
+	if (link->prev) link->prev->next = link->next;
+	else            chain->head      = link->next;
+	if (link->next) link->next->prev = link->prev;
+	else            chain->tail      = link->prev;
+	link->prev = link->next = NULL;
+	chain->length--;
+}
+
+/* Object pools */
+static void pool_grow(pool_t *pool)
+{
+	// The first slot of each block links the blocks together
+	char *block = malloc((pool->slab + 1) * pool->size);
+	*(void**)block = pool->blocks;
+	pool->blocks = block;
+	for (int i = pool->slab; i > 0; i--) {
+		void *item = block + i * pool->size;
+		*(void**)item = pool->free;
+		pool->free = item;
+	}
+	pool->allocs++;
+}
+
+void *pool_get(pool_t *pool)
+{
+	if (!pool->free && pool->slab)
+		pool_grow(pool);
+	void *item = pool->free;
+	if (item) {
+		pool->free = *(void**)item;
+		memset(item, 0, pool->size);
+	} else {
+		item = calloc(1, pool->size);
+		pool->allocs++;
+	}
+	if (++pool->live > pool->peak)
+		pool->peak = pool->live;
+	pool->gets++;
+	return item;
+}
+
+void pool_put(pool_t *pool, void *item)
+{
+	if (!item)
+		return;
+	*(void**)item = pool->free;
+	pool->free = item;
+	pool->live--;
+}
+
+void pool_free(pool_t *pool)
+{
+	// Slab blocks are freed whole, including any live objects
+	while (pool->blocks) {
+		void *block = pool->blocks;
+		pool->blocks = *(void**)block;
+		free(block);
+	}
+	while (pool->free && !pool->slab) {
+		void *item = pool->free;
+		pool->free = *(void**)item;
+		free(item);
+	}
+	pool->free = NULL;
+}
+
+/* Hash functions */
+unsigned hash_int(unsigned long key)
+{
+	// Fibonacci hashing, spreads sequential ids
+	return (key * 0x9E3779B97F4A7C15ull) >> 32;
+}
+
+unsigned hash_str(const char *str)
+{
+	// FNV-1a
+	unsigned hash = 2166136261u;
+	while (*str)
+		hash = (hash ^ (unsigned char)*str++) * 16777619u;
+	return hash;
+}
+
+/* Trace ring buffer */
+static ring_t   ring[RING_SIZE];
+static unsigned ring_pos;
+
+void ring_put(int op, unsigned long id, int a, int b, int c, int d)
+{
+	ring_t *rec = &ring[ring_pos++ & (RING_SIZE-1)];
+	rec->time = get_nsec();
+	rec->id   = id;
+	rec->op   = op;
+	rec->a    = a;  rec->b = b;
+	rec->c    = c;  rec->d = d;
+}
+
+int ring_dump(const char *path)
+{
+	/* Only uses write so it can be called from signal handlers,
+	 * records are written oldest first after a small header */
+	unsigned pos   = ring_pos;
+	unsigned count = MIN(pos, RING_SIZE);
+	unsigned first = (pos - count) & (RING_SIZE-1);
+	unsigned tail  = MIN(count, RING_SIZE - first);
+	int head[2]    = {sizeof(ring_t), count};
+
+	int fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (fd < 0)
+		return -1;
+	int err = 0;
+	err |= write(fd, RING_MAGIC, 4)      != 4;
+	err |= write(fd, head, sizeof(head)) != sizeof(head);
+	err |= write(fd, &ring[first], sizeof(ring_t)*tail)
+		!= sizeof(ring_t)*tail;
+	err |= write(fd, &ring[0], sizeof(ring_t)*(count-tail))
+		!= sizeof(ring_t)*(count-tail);
+	close(fd);
+	return err ? -1 : 0;
+}
+
 /* Misc */
-int residual(float num, float *state)
+int distribute(int *out, int *in, int n, int total)
 {
-	float f = num + *state;
-	int   i = (int)(f+0.5);
-	*state = f - i;
-	return i;
+	/* Each entry gets the rounded share of its running sum, so the
+	 * outputs always add up to total and nothing is carried between
+	 * calls. Zero weights are split evenly. */
+	long long sum = 0, cum = 0;
+	for (int i = 0; i < n; i++)
+		sum += in[i];
+	long long div = sum > 0 ? sum : n;
+	int prev = 0, changed = 0;
+	for (int i = 0; i < n; i++) {
+		cum += sum > 0 ? in[i] : 1;
+		int next = (2*cum*total + div) / (2*div);
+		changed |= out[i] != next - prev;
+		out[i]   = next - prev;
+		prev     = next;
+	}
+	return changed;
 }
 
 int str2num(char *str, int def)
@@ -141,6 +313,19 @@ int str2num(char *str, int def)
 	return end && *end == '\0' ? num : def;
 }
 
+long long get_nsec(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000000LL + ts.tv_nsec;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000000000LL + tv.tv_usec*1000LL;
+#endif
+}
+
 int warn(char *fmt, ...)
 {
 	va_list ap;
@@ -23,15 +23,13 @@
 
 #define countof(x) (sizeof(x)/sizeof((x)[0]))
 
-/* Constant length map functions */
-#define map_get(map, k, kv, v, def) ({         \
-	typeof(def) val = def;                 \
-	for (int i = 0; i < countof(map); i++) \
-		if (map[i].k == kv) {          \
-			val = map[i].v;        \
-			break;                 \
-		}                              \
-	val;                                   \
+/* Constant direct index maps
+ *   map[key-base] holds the value for key, built with designated
+ *   initializers so lookups are a single load. Zero entries and
+ *   keys outside the table return def. */
+#define map_get(map, base, key, def) ({                   \
+	unsigned long _idx = (unsigned long)(key) - (base); \
+	_idx < countof(map) && map[_idx] ? map[_idx] : (def); \
 })
 
 /* Linked lists */
@@ -57,11 +55,262 @@ list_t *list_find(list_t *list, void *data);
 
 list_t *list_sort(list_t *list, int rev, int (*func)(void*,void*));
 
+/* Intrusive lists
+ *   A link_t is embedded in each item,
+ *   use chain_entry to get the item back */
+typedef struct link {
+	struct link *prev;
+	struct link *next;
+} link_t;
+
+typedef struct {
+	link_t  *head;     // first item
+	link_t  *tail;     // last item
+	int      length;   // number of items
+} chain_t;
+
+#define chain_entry(ptr, type, member) ({                               \
+	link_t *_link = (ptr);                                          \
+	_link ? (type*)((char*)_link - __builtin_offsetof(type, member)) \
+	      : NULL;                                                   \
+})
+
+#define chain_foreach(chain, var, type, member)                  \
+	for (type *var = chain_entry((chain)->head, type, member); \
+	     var; var = chain_entry(var->member.next, type, member))
+
+void chain_insert(chain_t *chain, link_t *next, link_t *link);
+
+void chain_append(chain_t *chain, link_t *link);
+
+void chain_remove(chain_t *chain, link_t *link);
+
+/* Object pools
+ *   Freed objects are kept on a free list and reused,
+ *   slab pools allocate objects in blocks of .slab */
+typedef struct {
+	int     size;      // size of each object
+	int     slab;      // objects per block, 0 to allocate singly
+	void   *free;      // free list, linked through the objects
+	void   *blocks;    // slab blocks, linked through the first slot
+	int     live;      // objects currently in use
+	int     peak;      // most objects in use at once
+	int     gets;      // objects handed out
+	int     allocs;    // calls made to malloc
+} pool_t;
+
+#define POOL(type)    {.size = MAX(sizeof(type), sizeof(void*))}
+#define SLAB(type, n) {.size = MAX(sizeof(type), sizeof(void*)), .slab = n}
+
+void *pool_get(pool_t *pool);
+
+void pool_put(pool_t *pool, void *item);
+
+void pool_free(pool_t *pool);
+
+/* Node pool used by the list_t functions, one per thread */
+extern __thread pool_t list_pool;
+
+/* Vectors
+ *   Growable arrays of a given type, the size doubles
+ *   whenever they fill up so pushing is amortised O(1) */
+#define VECTOR(type) struct {  \
+	type   *items;         \
+	int     length;        \
+	int     size;          \
+}
+
+#define vec_push(vec, item) ({                                \
+	typeof(vec) _vec = (vec);                             \
+	if (_vec->length == _vec->size) {                     \
+		_vec->size  = MAX(_vec->size*2, 8);           \
+		_vec->items = realloc(_vec->items,            \
+			_vec->size * sizeof(*_vec->items));   \
+	}                                                     \
+	_vec->items[_vec->length] = (item);                   \
+	&_vec->items[_vec->length++];                         \
+})
+
+#define vec_del(vec, i) ({                                    \
+	typeof(vec) _vec = (vec);                             \
+	int         _idx = (i);                               \
+	_vec->items[_idx] = _vec->items[--_vec->length];      \
+})
+
+#define vec_free(vec) ({                                      \
+	free((vec)->items);                                   \
+	(vec)->items  = NULL;                                 \
+	(vec)->length = (vec)->size = 0;                      \
+})
+
+#define vec_foreach(vec, var)                                 \
+	for (typeof((vec)->items) var = (vec)->items;         \
+	     var < (vec)->items + (vec)->length; var++)
+
+/* Hash maps
+ *   HASHMAP declares name_t, an open addressing table from key
+ *   to val using linear probing, along with name_get, name_put
+ *   and name_del. Removing an item shifts the items after it
+ *   back so no tombstones are needed. hash(key) and equal(a,b)
+ *   may be functions or macros. */
+#define HASHMAP(name, key_t, val_t, hash, equal)                              \
+typedef struct {                                                              \
+	key_t   key;                                                          \
+	val_t   val;                                                          \
+	int     used;                                                         \
+} name##_slot_t;                                                              \
+                                                                              \
+typedef struct {                                                              \
+	name##_slot_t *slots;                                                 \
+	int     length;                                                       \
+	int     size;                                                         \
+} name##_t;                                                                   \
+                                                                              \
+static inline name##_slot_t *name##_find(name##_t *map, key_t key)            \
+{                                                                             \
+	unsigned mask = map->size - 1;                                        \
+	for (unsigned i = hash(key) & mask;; i = (i+1) & mask)                \
+		if (!map->slots[i].used || equal(map->slots[i].key, key))     \
+			return &map->slots[i];                                \
+}                                                                             \
+                                                                              \
+static inline val_t *name##_get(name##_t *map, key_t key)                     \
+{                                                                             \
+	if (map->size == 0)                                                   \
+		return NULL;                                                  \
+	name##_slot_t *slot = name##_find(map, key);                          \
+	return slot->used ? &slot->val : NULL;                                \
+}                                                                             \
+                                                                              \
+static inline val_t *name##_put(name##_t *map, key_t key, val_t val)          \
+{                                                                             \
+	if ((map->length+1)*4 > map->size*3) {                                \
+		name##_t old = *map;                                          \
+		map->size  = MAX(old.size*2, 16);                             \
+		map->slots = calloc(map->size, sizeof(name##_slot_t));        \
+		for (int i = 0; i < old.size; i++)                            \
+			if (old.slots[i].used)                                \
+				*name##_find(map, old.slots[i].key) =         \
+					old.slots[i];                         \
+		free(old.slots);                                              \
+	}                                                                     \
+	name##_slot_t *slot = name##_find(map, key);                          \
+	map->length += !slot->used;                                           \
+	*slot = (name##_slot_t){key, val, 1};                                 \
+	return &slot->val;                                                    \
+}                                                                             \
+                                                                              \
+static inline int name##_del(name##_t *map, key_t key)                        \
+{                                                                             \
+	if (map->size == 0)                                                   \
+		return 0;                                                     \
+	name##_slot_t *slot = name##_find(map, key);                          \
+	if (!slot->used)                                                      \
+		return 0;                                                     \
+	unsigned mask = map->size - 1;                                        \
+	unsigned hole = slot - map->slots;                                    \
+	for (unsigned i = (hole+1) & mask; map->slots[i].used;                \
+			i = (i+1) & mask) {                                   \
+		unsigned home = hash(map->slots[i].key) & mask;               \
+		if (((i - home) & mask) >= ((i - hole) & mask)) {             \
+			map->slots[hole] = map->slots[i];                     \
+			hole = i;                                             \
+		}                                                             \
+	}                                                                     \
+	map->slots[hole].used = 0;                                            \
+	map->length--;                                                        \
+	return 1;                                                             \
+}                                                                             \
+                                                                              \
+static inline void name##_free(name##_t *map)                                 \
+{                                                                             \
+	free(map->slots);                                                     \
+	*map = (name##_t){};                                                  \
+}
+
+#define hash_foreach(map, var)                                \
+	for (typeof((map)->slots) var = (map)->slots;         \
+	     var < (map)->slots + (map)->size; var++)         \
+		if (!var->used) continue; else
+
+unsigned hash_int(unsigned long key);
+
+unsigned hash_str(const char *str);
+
+/* Logging
+ *   Levels above LOG_LEVEL are compiled out,
+ *   the rest are filtered by category in log_mask */
+#define LOG_ERROR 1
+#define LOG_WARN  2
+#define LOG_INFO  3
+#define LOG_DEBUG 4
+#define LOG_TRACE 5
+
+#ifndef LOG_LEVEL
+#ifdef DEBUG
+#define LOG_LEVEL LOG_TRACE
+#else
+#define LOG_LEVEL LOG_WARN
+#endif
+#endif
+
+typedef enum {
+	LOG_SYS   = 1<<0, // requests to the windowing system
+	LOG_EVENT = 1<<1, // events from the windowing system
+	LOG_WM    = 1<<2, // window management actions
+	LOG_DUMP  = 1<<3, // layout dumps and statistics
+} log_t;
+
+extern int log_mask;
+
+#define logging(level, cat) \
+	((level) <= LOG_LEVEL && (log_mask & (cat)))
+
+#define LOG(level, cat, ...) do {        \
+	if (logging(level, cat))         \
+		printf(__VA_ARGS__);     \
+} while (0)
+
+#define info(cat, ...)  LOG(LOG_INFO,  cat, __VA_ARGS__)
+#define debug(cat, ...) LOG(LOG_DEBUG, cat, __VA_ARGS__)
+#define trace(cat, ...) LOG(LOG_TRACE, cat, __VA_ARGS__)
+
+/* Trace ring buffer
+ *   Fixed size binary records of recent operations,
+ *   cheap enough to leave enabled and dumped on demand */
+typedef enum {
+	RING_EVENT,        // event from the system, a = type
+	RING_MOVE,         // sys_move, a,b,c,d = x,y,w,h
+	RING_SHOW,         // sys_show, a = state
+	RING_RAISE,        // sys_raise
+	RING_FOCUS,        // sys_focus
+	RING_UPDATE,       // wm_update, a = touched, b = changed
+	RING_TAG,          // tag switch, a = name, b = time (us)
+	RING_INSERT,       // wm_insert
+	RING_REMOVE,       // wm_remove
+} ring_op_t;
+
+typedef struct {
+	long long     time; // from get_nsec
+	unsigned long id;   // window
+	int           op;   // ring_op_t
+	int           a, b, c, d;
+} ring_t;
+
+#define RING_SIZE  4096     // must be a power of two
+#define RING_MAGIC "WMTR"
+
+void ring_put(int op, unsigned long id, int a, int b, int c, int d);
+
+int ring_dump(const char *path);
+
 /* Misc */
-int residual(float num, float *state);
+int distribute(int *out, int *in, int n, int total);
 
 int str2num(char *str, int def);
 
+long long get_nsec(void);
+
 int warn(char *fmt, ...);
 
 int error(char *fmt, ...);
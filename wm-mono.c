@@ -16,6 +16,7 @@
 /* Brain-dead monocule window manager */
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "util.h"
 #include "types.h"
@@ -28,29 +29,35 @@
 #endif
 
 /* Data */
-list_t *wins;
-list_t *focus;
-list_t *screens;
+struct win_wm {
+	link_t   link;
+	win_t   *win;
+};
+
+chain_t  wins;
+link_t  *focus;
+list_t  *screens;
 
 /* Helper functions */
-static void wm_show(list_t *node)
+static void wm_show(link_t *link)
 {
-	focus = node;
-	if (!node) return;
-	sys_show(node->data, ST_MAX);
-	sys_raise(node->data);
-	sys_focus(node->data);
+	focus = link;
+	if (!link) return;
+	win_t *win = chain_entry(link, win_wm_t, link)->win;
+	sys_show(win, ST_MAX);
+	sys_raise(win);
+	sys_focus(win);
 }
 
 /* Window management functions */
 int wm_handle_event(win_t *win, event_t ev, mod_t mod, ptr_t ptr)
 {
-	list_t *node = list_find(wins, win);
+	link_t *link = win && win->wm ? &win->wm->link : NULL;
 
-	if (node && mod.MODKEY && ev == 'j')
-		return wm_show(node->next), 1;
-	if (node && mod.MODKEY && ev == 'k')
-		return wm_show(node->prev), 1;
+	if (link && mod.MODKEY && ev == 'j')
+		return wm_show(link->next), 1;
+	if (link && mod.MODKEY && ev == 'k')
+		return wm_show(link->prev), 1;
 
 	if (mod.MODKEY && mod.shift && ev == 'c')
 		return sys_show(win, ST_CLOSE), 1;
@@ -70,11 +77,24 @@ int wm_handle_state(win_t *win, state_t prev, state_t next)
 	return 0;
 }
 
+int wm_handle_screen(win_t *screen)
+{
+	wm_show(focus);
+	return 1;
+}
+
+int wm_handle_timer(void)
+{
+	return 0;
+}
+
 void wm_insert(win_t *win)
 {
 	if (win->type == TYPE_NORMAL) {
-		wins = list_append(wins, win);
-		wm_show(list_last(wins));
+		win->wm = new0(win_wm_t);
+		win->wm->win = win;
+		chain_append(&wins, &win->wm->link);
+		wm_show(wins.tail);
 	}
 	if (win->type == TYPE_TOOLBAR) {
 		wm_show(focus);
@@ -83,10 +103,14 @@ void wm_insert(win_t *win)
 
 void wm_remove(win_t *win)
 {
-	list_t *node = list_find(wins, win);
-	if (node == focus)
-		wm_show(node->prev ?: node->next);
-	wins = list_remove(wins, node, 0);
+	if (!win->wm)
+		return;
+	link_t *link = &win->wm->link;
+	if (link == focus)
+		wm_show(link->prev ?: link->next);
+	chain_remove(&wins, link);
+	free(win->wm);
+	win->wm = NULL;
 }
 
 void wm_init(void)
@@ -100,6 +124,10 @@ void wm_init(void)
 
 void wm_free(void)
 {
-	while (wins)
-		wins = list_remove(wins, wins, 0);
+	while (wins.head) {
+		win_wm_t *wm = chain_entry(wins.head, win_wm_t, link);
+		chain_remove(&wins, &wm->link);
+		wm->win->wm = NULL;
+		free(wm);
+	}
 }
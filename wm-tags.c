@@ -16,6 +16,7 @@
 /* Brain-dead multiple desktop manager */
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "util.h"
 #include "types.h"
@@ -28,8 +29,14 @@
 #endif
 
 /* Data */
-int     tag = 1;
-list_t *tags[10];
+struct win_wm {
+	link_t   link;
+	win_t   *win;
+	int      tag;
+};
+
+int      tag = 1;
+chain_t  tags[10];
 
 /* Window management functions */
 void wm_update(void)
@@ -44,17 +51,21 @@ int wm_handle_event(win_t *win, event_t ev, mod_t mod, ptr_t ptr)
 		return 0;
 
 	if (mod.shift) {
-		list_t *node = list_find(tags[tag], win);
-		if (node == NULL)
+		if (!win->wm || win->wm->tag != tag)
 			return 0;
-		tags[tag] = list_remove(tags[tag], node, 0);
-		tags[new] = list_insert(tags[new], win);
+		chain_remove(&tags[tag], &win->wm->link);
+		chain_insert(&tags[new], tags[new].head, &win->wm->link);
+		win->wm->tag = new;
 		sys_show(win, ST_HIDE);
 	} else {
-		for (list_t *cur = tags[new]; cur; cur = cur->next)
-			sys_show(cur->data, ST_SHOW);
-		for (list_t *cur = tags[tag]; cur; cur = cur->next)
-			sys_show(cur->data, ST_HIDE);
+		/* There is no layout step here, windows keep the
+		 * geometry they had and sys_show sends it before
+		 * mapping. Map the new tag before unmapping the old
+		 * one so the desktop is never left empty */
+		chain_foreach(&tags[new], cur, win_wm_t, link)
+			sys_show(cur->win, ST_SHOW);
+		chain_foreach(&tags[tag], cur, win_wm_t, link)
+			sys_show(cur->win, ST_HIDE);
 		tag = new;
 	}
 	return 1;
@@ -70,19 +81,31 @@ int wm_handle_state(win_t *win, state_t prev, state_t next)
 	return 0;
 }
 
+int wm_handle_screen(win_t *screen)
+{
+	return 0;
+}
+
+int wm_handle_timer(void)
+{
+	return 0;
+}
+
 void wm_insert(win_t *win)
 {
-	tags[tag] = list_insert(tags[tag], win);
+	win->wm = new0(win_wm_t);
+	win->wm->win = win;
+	win->wm->tag = tag;
+	chain_insert(&tags[tag], tags[tag].head, &win->wm->link);
 }
 
 void wm_remove(win_t *win)
 {
-	for (int i = 0; i < 10; i++) {
-		list_t *node = list_find(tags[i], win);
-		if (node == NULL)
-			continue;
-		tags[i] = list_remove(tags[i], node, 0);
-	}
+	if (!win->wm)
+		return;
+	chain_remove(&tags[win->wm->tag], &win->wm->link);
+	free(win->wm);
+	win->wm = NULL;
 }
 
 void wm_init(void)
@@ -97,9 +120,10 @@ void wm_init(void)
 void wm_free(void)
 {
 	for (int i = 0; i < 10; i++) {
-		while (tags[i]) {
-			sys_show(tags[i]->data, ST_SHOW);
-			tags[i] = list_remove(tags[i], tags[i], 0);
+		while (tags[i].head) {
+			win_t *win = chain_entry(tags[i].head, win_wm_t, link)->win;
+			sys_show(win, ST_SHOW);
+			wm_remove(win);
 		}
 	}
 }
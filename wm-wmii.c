@@ -29,6 +29,7 @@
 #endif
 static int margin = 0;
 static int stack  = 25;
+static int rate   = 60; // relayouts per second while dragging
 
 /* Enums */
 typedef enum {
@@ -43,86 +44,135 @@ typedef enum {
 	TILING, FLOATING
 } layer_t;
 
-/* Window structure types */
-struct win_wm { };
-
+/* Window structure types
+ *   Columns and rows are stored in arrays, column widths and
+ *   row heights are kept in separate arrays next to them so the
+ *   scaling loops only scan packed ints */
 typedef struct {
 	win_t   *win;      // the window
-	int      height;   // win height in _this_ tag
 	state_t  state;    // state of window
 } row_t;
 
 typedef struct {
-	list_t  *rows;     // of row_t
-	row_t   *row;      // focused row
-	int      width;    // column width
+	row_t   *rows;     // array of nrows
+	int     *heights;  // win heights in _this_ tag, parallel to rows
+	int      nrows;    // number of rows in use
+	int      srows;    // allocated size of rows and heights
+	int      row;      // focused row, or -1
 	layout_t layout;   // column layout
+	int      dirty;    // rows need to be relaid out
 } col_t;
 
 typedef struct {
+	link_t   link;     // in dpy->flts
 	win_t   *win;      // the window
 	int x, y, w, h;    // position of window (in this tag)
 	state_t  state;    // state of window
 } flt_t;
 
 typedef struct {
-	list_t  *cols;     // of col_t
-	col_t   *col;      // focused col
-	list_t  *flts;     // of flt_t
+	link_t   link;     // in tag->dpys
+	col_t   *cols;     // array of ncols
+	int     *widths;   // column widths, parallel to cols
+	int      ncols;    // number of cols in use
+	int      scols;    // allocated size of cols and widths
+	int      col;      // focused col, or -1
+	chain_t  flts;     // of flt_t, in stacking order
 	flt_t   *flt;      // focused flt
 	layer_t  layer;    // focused layer
 	win_t   *geom;     // display size and position
+	win_t   *top;      // last tiled window raised
+	int      restack;  // flts need to be raised in order
+	int      dirty;    // all cols need to be relaid out
+	int      reshow;   // tag was hidden, re-emit clean cols
 } dpy_t;
 
 typedef struct {
-	list_t  *dpys;     // of dpy_t
+	link_t   link;     // in wm->tags
+	link_t   bucket;   // in wm->index
+	chain_t  dpys;     // of dpy_t
 	dpy_t   *dpy;      // focused dpy
 	char     name[64]; // tag name
+	unsigned hash;     // hash of name
+	int      dirty;    // all dpys need to be relaid out
 } tag_t;
 
+/* Window geometry and state computed by the layout */
 typedef struct {
-	list_t  *tags;     // of tag_t
+	win_t   *win;      // the window
+	int x, y, w, h;    // target position
+	int      move;     // position is used
+	state_t  state;    // target state
+} frame_t;
+
+/* Window location index
+ *   Points at the links which hold the window so that
+ *   finding a window does not need to walk every tag */
+struct win_wm {
+	tag_t   *tag;      // tag containing the window
+	link_t  *dpy;      // link in tag->dpys
+	int      col;      // index in dpy->cols, tiling only
+	int      row;      // index in col->rows, tiling only
+	link_t  *flt;      // link in dpy->flts, floating only
+	frame_t  frame;    // last frame sent to the system
+};
+
+typedef struct {
+	chain_t  tags;     // of tag_t
+	chain_t  index[64];// of tag_t, by name hash
+	tag_t   *digit[10];// tags named 0-9
 	tag_t   *tag;      // focused tag
+	tag_t   *hide;     // previous tag, hidden on next update
+	tag_t   *show;     // new tag, shown on next update
 	list_t  *screens;  // display geometry
+	win_t   *focus;    // last window passed to sys_focus
+	int      focused;  // number of focus requests sent
+	int      skipped;  // number of redundant focus requests
 } wm_t;
 
-#define WIN(node) ((win_t*)(node)->data)
-#define ROW(node) ((row_t*)(node)->data)
-#define COL(node) ((col_t*)(node)->data)
-#define FLT(node) ((flt_t*)(node)->data)
-#define DPY(node) ((dpy_t*)(node)->data)
-#define TAG(node) ((tag_t*)(node)->data)
+#define FLT(l) chain_entry(l, flt_t, link)
+#define DPY(l) chain_entry(l, dpy_t, link)
+#define TAG(l) chain_entry(l, tag_t, link)
 
 #define tag_foreach_col(tag, dpy, col, row, win) \
-	for (list_t *dpy =     tag ->dpys; dpy; dpy = dpy->next) \
-	for (list_t *col = DPY(dpy)->cols; col; col = col->next) \
-	for (list_t *row = COL(col)->rows; row; row = row->next) \
-	for (win_t  *win = ROW(row)->win;  win; win = NULL)
+	for (link_t *dpy =     tag ->dpys.head; dpy; dpy = dpy->next) \
+	for (col_t  *col = DPY(dpy)->cols; col < DPY(dpy)->cols + DPY(dpy)->ncols; col++) \
+	for (row_t  *row =      col ->rows; row < col->rows + col->nrows; row++) \
+	for (win_t  *win =      row ->win;  win; win = NULL)
 
 #define tag_foreach_flt(tag, dpy, flt, win) \
-	for (list_t *dpy =     tag ->dpys; dpy; dpy = dpy->next) \
-	for (list_t *flt = DPY(dpy)->flts; flt; flt = flt->next) \
+	for (link_t *dpy =     tag ->dpys.head; dpy; dpy = dpy->next) \
+	for (link_t *flt = DPY(dpy)->flts.head; flt; flt = flt->next) \
 	for (win_t  *win = FLT(flt)->win;  win; win = NULL)      \
 
 /* Window management data
  *   wm_* macros represent the currently focused item
  *   _only_ wm_focus protects against NULL pointers */
 static wm_t *wm;
+static frame_t *frames;  // computed by the layout pass
+static int      nframes; // number of frames in use
+static int      sframes; // allocated size of frames
 #define wm_tag   wm->tag
 #define wm_dpy   wm->tag->dpy
-#define wm_col   wm->tag->dpy->col
-#define wm_row   wm->tag->dpy->col->row
+#define wm_col   get_col(wm_dpy)
+#define wm_row   get_row(wm_col)
 #define wm_flt   wm->tag->dpy->flt
 #define wm_focus get_focus()
 
+/* Object pools */
+static pool_t pool_tag = POOL(tag_t);
+static pool_t pool_dpy = POOL(dpy_t);
+static pool_t pool_flt = POOL(flt_t);
+static pool_t pool_loc = POOL(win_wm_t);
+
 /* Mouse drag data */
 static drag_t  move_mode;
-static list_t *move_lrow;
-static list_t *move_lcol;
-static list_t *move_lflt;
+static win_t  *move_win;
 static ptr_t   move_prev;
 static layer_t move_layer;
 static struct { int v, h; } move_dir;
+static long long move_time;
+static int     move_timer; // sys_timer is pending
 
 /* Prototypes */
 void wm_update(void);
@@ -136,13 +186,23 @@ static int sort_win(void *a, void *b)
 	       ((win_t*)a)->x < ((win_t*)b)->x ? -1 : 0;
 }
 
+static col_t *get_col(dpy_t *dpy)
+{
+	return dpy && dpy->col >= 0 ? &dpy->cols[dpy->col] : NULL;
+}
+
+static row_t *get_row(col_t *col)
+{
+	return col && col->row >= 0 ? &col->rows[col->row] : NULL;
+}
+
 static win_t *get_focus(void)
 {
 	if (!wm_tag || !wm_dpy)
 		return NULL;
 	switch (wm_dpy->layer) {
 	case TILING:
-		return wm_col && wm_row ? wm_row->win : NULL;
+		return wm_row ? wm_row->win : NULL;
 	case FLOATING:
 		return wm_flt ? wm_flt->win : NULL;
 	}
@@ -150,24 +210,23 @@ static win_t *get_focus(void)
 }
 
 /* Search for the target window in a given tag
- * win may exist in other tags as well */
+ *   This uses the location index from win->wm */
 static int searchl(tag_t *tag, win_t *target,
-		list_t **_dpy, list_t **_col, list_t **_row, list_t **_flt)
-{
-	tag_foreach_col(tag, dpy, col, row, win) {
-		if (win == target) {
-			if (_dpy) *_dpy = dpy;
-			if (_col) *_col = col;
-			if (_row) *_row = row;
-			return TILING;
-		}
+		link_t **_dpy, int *_col, int *_row, link_t **_flt)
+{
+	win_wm_t *loc = target ? target->wm : NULL;
+	if (!tag || !loc || loc->tag != tag)
+		return -1;
+	if (loc->row >= 0) {
+		if (_dpy) *_dpy = loc->dpy;
+		if (_col) *_col = loc->col;
+		if (_row) *_row = loc->row;
+		return TILING;
 	}
-	tag_foreach_flt(tag, dpy, flt, win) {
-		if (win == target) {
-			if (_dpy) *_dpy = dpy;
-			if (_flt) *_flt = flt;
-			return FLOATING;
-		}
+	if (loc->flt) {
+		if (_dpy) *_dpy = loc->dpy;
+		if (_flt) *_flt = loc->flt;
+		return FLOATING;
 	}
 	return -1;
 }
@@ -175,12 +234,13 @@ static int searchl(tag_t *tag, win_t *target,
 static int search(tag_t *tag, win_t *target,
 		dpy_t **_dpy, col_t **_col, row_t **_row, flt_t **_flt)
 {
-	list_t *dpy, *col, *row, *flt;
+	link_t *dpy, *flt;
+	int col, row;
 	switch (searchl(tag, target, &dpy, &col, &row, &flt)) {
 	case TILING:
 		if (_dpy) *_dpy = DPY(dpy);
-		if (_col) *_col = COL(col);
-		if (_row) *_row = ROW(row);
+		if (_col) *_col = &DPY(dpy)->cols[col];
+		if (_row) *_row = &DPY(dpy)->cols[col].rows[row];
 		return TILING;
 	case FLOATING:
 		if (_dpy) *_dpy = DPY(dpy);
@@ -190,38 +250,171 @@ static int search(tag_t *tag, win_t *target,
 	return -1;
 }
 
+/* Record where a window is stored */
+static void set_loc(win_t *win, tag_t *tag,
+		link_t *dpy, int col, int row, link_t *flt)
+{
+	if (!win->wm)
+		win->wm = pool_get(&pool_loc);
+	win->wm->tag = tag;
+	win->wm->dpy = dpy;
+	win->wm->col = col;
+	win->wm->row = row;
+	win->wm->flt = flt;
+}
+
+/* Update the location index after rows have shifted */
+static void set_rows(dpy_t *dpy, int col, int row)
+{
+	col_t *cur = &dpy->cols[col];
+	for (; row < cur->nrows; row++) {
+		cur->rows[row].win->wm->col = col;
+		cur->rows[row].win->wm->row = row;
+	}
+}
+
+/* Update the location index after columns have shifted */
+static void set_cols(dpy_t *dpy, int col)
+{
+	for (; col < dpy->ncols; col++)
+		set_rows(dpy, col, 0);
+}
+
+/* Insert an empty column
+ *   Removed columns are kept past ncols so that
+ *   their row buffers can be reused here */
+static col_t *col_add(dpy_t *dpy, int col)
+{
+	if (dpy->ncols == dpy->scols) {
+		int size = MAX(dpy->scols*2, 4);
+		dpy->cols   = realloc(dpy->cols,   sizeof(col_t)*size);
+		dpy->widths = realloc(dpy->widths, sizeof(int)*size);
+		memset(&dpy->cols[dpy->scols], 0, sizeof(col_t)*(size-dpy->scols));
+		dpy->scols  = size;
+	}
+	col_t spare = dpy->cols[dpy->ncols];
+	memmove(&dpy->cols[col+1],   &dpy->cols[col],
+			sizeof(col_t)*(dpy->ncols-col));
+	memmove(&dpy->widths[col+1], &dpy->widths[col],
+			sizeof(int)*(dpy->ncols-col));
+	dpy->cols[col] = (col_t){
+		.rows    = spare.rows,
+		.heights = spare.heights,
+		.srows   = spare.srows,
+		.row     = -1,
+	};
+	dpy->widths[col] = 0;
+	dpy->ncols++;
+	if (dpy->col >= col)
+		dpy->col++;
+	return &dpy->cols[col];
+}
+
+/* Remove an empty column */
+static void col_del(dpy_t *dpy, int col)
+{
+	col_t spare = dpy->cols[col];
+	memmove(&dpy->cols[col],   &dpy->cols[col+1],
+			sizeof(col_t)*(dpy->ncols-col-1));
+	memmove(&dpy->widths[col], &dpy->widths[col+1],
+			sizeof(int)*(dpy->ncols-col-1));
+	dpy->ncols--;
+	dpy->cols[dpy->ncols] = spare;
+}
+
+/* Free all columns, including unused ones */
+static void col_free(dpy_t *dpy)
+{
+	for (int i = 0; i < dpy->scols; i++) {
+		free(dpy->cols[i].rows);
+		free(dpy->cols[i].heights);
+	}
+	free(dpy->cols);
+	free(dpy->widths);
+}
+
+/* Insert a row for the window */
+static row_t *row_add(col_t *col, int row, win_t *win)
+{
+	if (col->nrows == col->srows) {
+		col->srows   = MAX(col->srows*2, 4);
+		col->rows    = realloc(col->rows,    sizeof(row_t)*col->srows);
+		col->heights = realloc(col->heights, sizeof(int)*col->srows);
+	}
+	memmove(&col->rows[row+1],    &col->rows[row],
+			sizeof(row_t)*(col->nrows-row));
+	memmove(&col->heights[row+1], &col->heights[row],
+			sizeof(int)*(col->nrows-row));
+	col->rows[row]    = (row_t){win, win->state};
+	col->heights[row] = 0;
+	col->nrows++;
+	if (col->row >= row)
+		col->row++;
+	return &col->rows[row];
+}
+
+/* Remove a row */
+static void row_del(col_t *col, int row)
+{
+	memmove(&col->rows[row],    &col->rows[row+1],
+			sizeof(row_t)*(col->nrows-row-1));
+	memmove(&col->heights[row], &col->heights[row+1],
+			sizeof(int)*(col->nrows-row-1));
+	col->nrows--;
+}
+
 /* Set the layout for the windows column in the current tag */
 static void set_mode(win_t *win, layout_t layout)
 {
 	col_t *col;
 	if (TILING != search(wm_tag, win, NULL, &col, NULL, NULL))
 		return;
-	printf("set_mode: %p, %d -> %d\n",
+	debug(LOG_WM, "set_mode: %p, %d -> %d\n",
 			col, col->layout, layout);
 	col->layout = layout;
+	col->dirty  = 1;
 	if (col->layout == SPLIT)
-		for (list_t *cur = col->rows; cur; cur = cur->next) {
-			row_t *row = cur->data;
-			row->height = wm_dpy->geom->h;
-		}
+		for (int i = 0; i < col->nrows; i++)
+			col->heights[i] = wm_dpy->geom->h;
 	wm_update();
 }
 
+/* Send focus to the system unless it already has it */
+static void send_focus(win_t *win)
+{
+	if (win == wm->focus) {
+		wm->skipped++;
+		return;
+	}
+	wm->focus = win;
+	wm->focused++;
+	sys_focus(win);
+}
+
 /* Focus the window in the current tag and record
- * it as the currently focused window */
+ * it as the currently focused window, clearing the
+ * focus is always sent */
 static void set_focus(win_t *win)
 {
 	if (win == NULL) {
+		wm->focus = NULL;
+		wm->focused++;
 		sys_focus(NULL);
 		return;
 	}
+	if (win == wm->focus && win == wm_focus) {
+		wm->skipped++;
+		return;
+	}
 
-	dpy_t *dpy; col_t *col; row_t *row; flt_t *flt;
-	switch (search(wm_tag, win, &dpy, &col, &row, &flt)) {
+	dpy_t *dpy; col_t *col; flt_t *flt;
+	switch (search(wm_tag, win, &dpy, &col, NULL, &flt)) {
 	case TILING:
-		wm_dpy = dpy;
-		wm_col = col;
-		wm_row = row;
+		if (col->row != win->wm->row && col->layout != SPLIT)
+			col->dirty = 1;
+		wm_dpy   = dpy;
+		dpy->col = win->wm->col;
+		col->row = win->wm->row;
 		dpy->layer = TILING;
 		break;
 	case FLOATING:
@@ -230,21 +423,35 @@ static void set_focus(win_t *win)
 		dpy->layer = FLOATING;
 		break;
 	}
-	sys_focus(win);
+	send_focus(win);
+}
+
+/* Hide a window that left the current tag, the system no
+ * longer has it focused once it is unmapped */
+static void hide_win(win_t *win)
+{
+	sys_show(win, ST_HIDE);
+	if (win == wm->focus)
+		wm->focus = NULL;
 }
 
 /* Save mouse start location when moving/resizing windows */
 static void set_move(win_t *win, ptr_t ptr, drag_t drag)
 {
-	printf("set_move: %d - %p@%d,%d\n",
+	debug(LOG_WM, "set_move: %d - %p@%d,%d\n",
 			drag, win, ptr.rx, ptr.ry);
-	move_mode = drag;
+	drag_t prev = move_mode;
+	move_mode = NONE;
+	if (prev == RESIZE && move_layer == TILING)
+		wm_update();
 	if (drag == MOVE || drag == RESIZE) {
-		move_layer = searchl(wm_tag, win, NULL,
-				&move_lcol, &move_lrow, &move_lflt);
+		move_layer = searchl(wm_tag, win, NULL, NULL, NULL, NULL);
 		if (move_layer < 0)
 			return;
+		move_mode = drag;
+		move_win  = win;
 		move_prev = ptr;
+		move_time = 0;
 		int midy = win->y + (win->h/2);
 		int midx = win->x + (win->w/2);
 		move_dir.v = ptr.ry < midy ? -1 : +1;
@@ -256,39 +463,51 @@ static void set_move(win_t *win, ptr_t ptr, drag_t drag)
  * Quite useful for debugging */
 static void print_txt(void)
 {
-	for (list_t *ltag = wm->tags; ltag; ltag = ltag->next) {
-		tag_t *tag = ltag->data;
-		printf("tag:       <%-9p [%p->%p] >%-9p d=%-9p - %s\n",
-				ltag->prev, ltag, ltag->data, ltag->next,
+	for (link_t *ltag = wm->tags.head; ltag; ltag = ltag->next) {
+		tag_t *tag = TAG(ltag);
+		printf("tag:       <%-9p [%p] >%-9p d=%-9p - %s\n",
+				ltag->prev, tag, ltag->next,
 				tag->dpy, tag->name);
-	for (list_t *ldpy = tag->dpys; ldpy; ldpy = ldpy->next) {
-		dpy_t *dpy  = ldpy->data;
+	for (link_t *ldpy = tag->dpys.head; ldpy; ldpy = ldpy->next) {
+		dpy_t *dpy  = DPY(ldpy);
 		win_t *geom = dpy->geom;
-		printf("  dpy:     <%-9p [%p->%p] >%-9p %c=%-9p - %d,%d %dx%d\n",
-				ldpy->prev, ldpy, ldpy->data, ldpy->next,
+		printf("  dpy:     <%-9p [%p] >%-9p %c=%-9p - %d,%d %dx%d\n",
+				ldpy->prev, dpy, ldpy->next,
 				dpy->layer == TILING ? 'c' : 'f',
-				dpy->layer == TILING ? (void*)dpy->col : (void*)dpy->flt,
+				dpy->layer == TILING ? (void*)wm_col : (void*)dpy->flt,
 				geom->x, geom->y, geom->h, geom->w);
-	for (list_t *lcol = dpy->cols; lcol; lcol = lcol->next) {
-		col_t *col = lcol->data;
-		printf("    col:   <%-9p [%p->%p] >%-9p r=%-9p - %dpx @ %d\n",
-				lcol->prev, lcol, lcol->data, lcol->next,
-				col->row, col->width, col->layout);
-	for (list_t *lrow = col->rows; lrow; lrow = lrow->next) {
-		row_t *row = lrow->data;
+	for (int c = 0; c < dpy->ncols; c++) {
+		col_t *col = &dpy->cols[c];
+		printf("    col:   %-3d [%p] r=%-3d - %dpx @ %d\n",
+				c, col, col->row, dpy->widths[c], col->layout);
+	for (int r = 0; r < col->nrows; r++) {
+		row_t *row = &col->rows[r];
 		win_t *win = row->win;
-		printf("      row: <%-9p [%p>>%p] >%-9p focus=%d%d    - %4dpx \n",
-				lrow->prev, lrow, win, lrow->next,
-				col->row == row, wm_focus == win, win->h);
+		printf("      row: %-3d [%p>>%p] focus=%d%d    - %4dpx \n",
+				r, row, win,
+				col->row == r, wm_focus == win, win->h);
 	} }
-	for (list_t *lflt = dpy->flts; lflt; lflt = lflt->next) {
-		flt_t *flt = lflt->data;
+	for (link_t *lflt = dpy->flts.head; lflt; lflt = lflt->next) {
+		flt_t *flt = FLT(lflt);
 		win_t *win = flt->win;
 		printf("    flt:   <%-9p [%p>>%p] >%-9p focus=%d%d    - %d,%d %dx%d \n",
-				lflt->prev, lflt, win, lflt->next,
+				lflt->prev, flt, win, lflt->next,
 				dpy->flt == flt, wm_focus == flt->win,
 				flt->x, flt->y, flt->h, flt->w);
 	}  } }
+	printf("focus:     %p - %d sent, %d skipped\n",
+			wm->focus, wm->focused, wm->skipped);
+	printf("pools:     tag=%d/%d dpy=%d/%d flt=%d/%d loc=%d/%d list=%d/%d\n",
+			pool_tag.live, pool_tag.peak, pool_dpy.live, pool_dpy.peak,
+			pool_flt.live, pool_flt.peak, pool_loc.live, pool_loc.peak,
+			list_pool.live, list_pool.peak);
+}
+
+/* Print the layout after each change, only when tracing dumps */
+static void trace_txt(void)
+{
+	if (logging(LOG_TRACE, LOG_DUMP))
+		print_txt();
 }
 
 /* Cleanly remove a window from a tag
@@ -296,27 +515,42 @@ static void print_txt(void)
  *   Prunes empty lists */
 static layer_t cut_win(win_t *win, tag_t *tag)
 {
-	list_t *ldpy, *lcol, *lrow, *lflt;
-	layer_t layer = searchl(tag, win, &ldpy, &lcol, &lrow, &lflt);
+	link_t *ldpy, *lflt;
+	int c, r;
+	layer_t layer = searchl(tag, win, &ldpy, &c, &r, &lflt);
+
+	/* Stop dragging a window that leaves its place */
+	if (win == move_win) {
+		move_mode = NONE;
+		move_win  = NULL;
+	}
 
 	if (layer == TILING) {
 		dpy_t *dpy = DPY(ldpy);
-		col_t *col = COL(lcol);
-		col->row  = lrow->prev ? lrow->prev->data :
-			    lrow->next ? lrow->next->data : NULL;
-		col->rows = list_remove(col->rows, lrow, 1);
-		if (col->rows == NULL && (lcol->next || lcol->prev)) {
-			dpy->col  = lcol->prev ? lcol->prev->data :
-				    lcol->next ? lcol->next->data : NULL;
-			dpy->cols = list_remove(dpy->cols, lcol, 1);
+		col_t *col = &dpy->cols[c];
+		row_del(col, r);
+		set_rows(dpy, c, r);
+		col->row   = r > 0      ? r-1 :
+			     col->nrows ? 0   : -1;
+		col->dirty = 1;
+		set_loc(win, NULL, NULL, -1, -1, NULL);
+		if (dpy->top == win)
+			dpy->top = NULL;
+		if (col->nrows == 0 && dpy->ncols > 1) {
+			dpy->dirty = 1;
+			col_del(dpy, c);
+			set_cols(dpy, c);
+			dpy->col = c > 0 ? c-1 : 0;
 		}
 	}
 
 	if (layer == FLOATING) {
 		dpy_t *dpy = DPY(ldpy);
-		dpy->flts = list_remove(dpy->flts, lflt, 1);
-		dpy->flt  = dpy->flts ? list_last(dpy->flts)->data : NULL;
-		if (!dpy->flt && dpy->col && dpy->col->row)
+		chain_remove(&dpy->flts, lflt);
+		pool_put(&pool_flt, FLT(lflt));
+		dpy->flt  = FLT(dpy->flts.tail);
+		set_loc(win, NULL, NULL, -1, -1, NULL);
+		if (!dpy->flt && get_row(get_col(dpy)))
 			dpy->layer = TILING;
 	}
 
@@ -325,41 +559,39 @@ static layer_t cut_win(win_t *win, tag_t *tag)
 
 /* Insert a window into the tiling layer
  *   The window is added immediately after the
- *   columns currently focused row */
-static void put_win_col(win_t *win, tag_t *tag, dpy_t *dpy, col_t *col)
+ *   columns currently focused row, a new column is
+ *   created at the start if col is negative */
+static void put_win_col(win_t *win, tag_t *tag, dpy_t *dpy, int c)
 {
-	row_t *row = new0(row_t);
-	row->win   = win;
-	row->state = win->state;
-
-	if (col == NULL) {
-		col = new0(col_t);
-		dpy->cols = list_insert(dpy->cols, col);
+	if (c < 0) {
+		c = 0;
+		col_add(dpy, c);
+		set_cols(dpy, c+1);
 	}
 
-	int nrows = list_length(col->rows);
-	if (col->row) {
-		list_t *prev = list_find(col->rows, col->row);
-		list_insert_after(prev, row);
-	} else {
-		col->rows = list_insert(col->rows, row);
-	}
-	tag->dpy           = dpy;
-	tag->dpy->col      = col;
-	tag->dpy->col->row = row;
-	tag->dpy->layer    = TILING;
+	col_t *col = &dpy->cols[c];
+	int nrows = col->nrows;
+	int r     = col->row >= 0 ? col->row+1 : 0;
+	row_add(col, r, win);
+	set_loc(win, tag, &dpy->link, c, r, NULL);
+	set_rows(dpy, c, r+1);
+	tag->dpy        = dpy;
+	tag->dpy->col   = c;
+	col->row        = r;
+	tag->dpy->layer = TILING;
 
-	row->height = dpy->geom->h / MAX(nrows,1);
+	col->heights[r] = dpy->geom->h / MAX(nrows,1);
+	col->dirty      = 1;
 	if (nrows == 0) {
-		int ncols = list_length(dpy->cols);
-		col->width = dpy->geom->w / MAX(ncols-1,1);
+		dpy->dirty = 1;
+		dpy->widths[c] = dpy->geom->w / MAX(dpy->ncols-1,1);
 	}
 }
 
 /* Insert a window into the floating layer */
 static void put_win_flt(win_t *win, tag_t *tag, dpy_t *dpy)
 {
-	flt_t *flt = new0(flt_t);
+	flt_t *flt = pool_get(&pool_flt);
 	flt->win   = win;
 	flt->w     = dpy->geom->w / 2;
 	flt->h     = dpy->geom->h / 2;
@@ -370,7 +602,9 @@ static void put_win_flt(win_t *win, tag_t *tag, dpy_t *dpy)
 		flt->x = dpy->flt->x + 20;
 		flt->y = dpy->flt->y + 20;
 	}
-	dpy->flts = list_append(dpy->flts, flt);
+	chain_append(&dpy->flts, &flt->link);
+	set_loc(win, tag, &dpy->link, -1, -1, &flt->link);
+	dpy->restack    = 1;
 	tag->dpy        = dpy;
 	tag->dpy->flt   = flt;
 	tag->dpy->layer = FLOATING;
@@ -391,41 +625,50 @@ static void put_win(win_t *win, tag_t *tag, layer_t layer)
 static void shift_window(win_t *win, int col, int row)
 {
 	if (!win) return;
-	printf("shift_window: %p - %+d,%+d\n", win, col, row);
-	print_txt();
-	printf("shift_window: >>>\n");
-	list_t *ldpy, *lcol, *lrow, *lflt;
-	if (TILING != searchl(wm_tag, win, &ldpy, &lcol, &lrow, &lflt))
+	debug(LOG_WM, "shift_window: %p - %+d,%+d\n", win, col, row);
+	trace_txt();
+	debug(LOG_WM, "shift_window: >>>\n");
+	link_t *ldpy;
+	int c, r;
+	if (TILING != searchl(wm_tag, win, &ldpy, &c, &r, NULL))
 		return;
-	dpy_t *dpy = ldpy->data;
+	dpy_t *src = DPY(ldpy), *dpy = src;
 	if (row != 0) {
 		/* Move with a column, just swap rows */
-		list_t *src = lrow, *dst = NULL;
-		if (row < 0) dst = src->prev;
-		if (row > 0) dst = src->next;
-		if (src && dst) {
-			printf("swap: %p <-> %p\n", src->data, dst->data);
-			row_t *tmp = src->data;
-			src->data = dst->data;
-			dst->data = tmp;
+		col_t *cur = &dpy->cols[c];
+		int dst = r + (row < 0 ? -1 : +1);
+		if (0 <= dst && dst < cur->nrows) {
+			debug(LOG_WM, "swap: %p <-> %p\n", cur->rows[r].win, cur->rows[dst].win);
+			row_t tmp = cur->rows[r];
+			int   hgt = cur->heights[r];
+			cur->rows[r]      = cur->rows[dst];
+			cur->heights[r]   = cur->heights[dst];
+			cur->rows[dst]    = tmp;
+			cur->heights[dst] = hgt;
+			if      (cur->row == r)   cur->row = dst;
+			else if (cur->row == dst) cur->row = r;
+			cur->rows[r].win->wm->row   = r;
+			cur->rows[dst].win->wm->row = dst;
+			cur->dirty = 1;
 			goto update;
 		}
 	} else {
 		/* Moving between columns */
-		int onlyrow = !lrow->prev && !lrow->next;
-		list_t *src = lcol, *dst = NULL;
+		int onlyrow = dpy->cols[c].nrows == 1;
+		int dst = -1;
 		if (col < 0) {
-			if (src->prev) {
+			if (c > 0) {
 				/* Normal move between columns */
-				dst = src->prev;
+				dst = c-1;
 			} else if (!onlyrow) {
 				/* Create new column */
-				dpy->cols = list_insert(dpy->cols, new0(col_t));
-				dst = src->prev;
+				col_add(dpy, 0);
+				set_cols(dpy, 1);
+				dst = 0;
 			} else if (ldpy->prev) {
 				/* Move to next monitor */
-				dpy = ldpy->prev->data;
-				dst = list_last(dpy->cols);
+				dpy = DPY(ldpy->prev);
+				dst = dpy->ncols-1;
 			} else {
 				/* We, shall, not, be,
 				 * we shall not be moved */
@@ -433,91 +676,95 @@ static void shift_window(win_t *win, int col, int row)
 			}
 		}
 		if (col > 0) {
-			if (src->next) {
-				dst = src->next;
+			if (c < dpy->ncols-1) {
+				dst = c+1;
 			} else if (!onlyrow) {
-				dpy->cols = list_append(dpy->cols, new0(col_t));
-				dst = src->next;
+				col_add(dpy, dpy->ncols);
+				dst = dpy->ncols-1;
 			} else if (ldpy->next) {
-				dpy = ldpy->next->data;
-				dst = dpy->cols;
+				dpy = DPY(ldpy->next);
+				dst = dpy->ncols ? 0 : -1;
 			} else {
 				return;
 			}
 		}
+		int ncols = src->ncols;
 		cut_win(win, wm_tag);
-		put_win_col(win, wm_tag, dpy, dst ? dst->data : NULL);
+		if (dpy == src && src->ncols < ncols && dst > c)
+			dst--;
+		put_win_col(win, wm_tag, dpy, dst);
 		goto update;
 	}
 update:
-	print_txt();
+	trace_txt();
 	wm_update();
 }
 
 /* Get next/prev item, with wraparound */
-static list_t *get_next(list_t *list, int forward)
+static link_t *get_next(chain_t *chain, link_t *link, int forward)
 {
-	list_t *next = forward ? list->next : list->prev;
-	if (next == NULL) {
-		next = list;
-		while ((list = forward ? next->prev : next->next))
-			next = list;
-	}
+	link_t *next = forward ? link->next : link->prev;
+	if (next == NULL)
+		next = forward ? chain->head : chain->tail;
 	return next;
 }
 
 /* Move keyboard focus in a given direction */
 static void shift_focus(int cols, int rows)
 {
-	printf("shift_focus: %+d,%+d\n", cols, rows);
+	debug(LOG_WM, "shift_focus: %+d,%+d\n", cols, rows);
 	if (rows != 0 && wm_focus) {
 		/* Move focus up/down */
-		list_t *dpy, *col, *row;
-		if (TILING != searchl(wm_tag, wm_focus, &dpy, &col, &row, NULL))
+		link_t *dpy;
+		int c, r;
+		if (TILING != searchl(wm_tag, wm_focus, &dpy, &c, &r, NULL))
 			return;
-		row_t *next = get_next(row, rows > 0)->data;
-		set_focus(next->win);
-		if (COL(col)->layout != SPLIT)
+		col_t *col = &DPY(dpy)->cols[c];
+		int next = (r + (rows > 0 ? 1 : col->nrows-1)) % col->nrows;
+		set_focus(col->rows[next].win);
+		if (col->layout != SPLIT)
 			wm_update();
 	}
 	if (cols != 0) {
 		/* Move focus left/right */
-		list_t *dpy, *col, *row, *ndpy, *ncol = NULL;
+		link_t *dpy, *ndpy;
+		int c, r, ncol = -1;
 		if (wm_focus) {
 			/* Currently focused on a window */
-			if (TILING != searchl(wm_tag, wm_focus, &dpy, &col, &row, NULL))
+			if (TILING != searchl(wm_tag, wm_focus, &dpy, &c, &r, NULL))
 				return;
-			ncol = cols > 0 ? col->next : col->prev;
+			ncol = c + (cols > 0 ? 1 : -1);
+			if (ncol >= DPY(dpy)->ncols)
+				ncol = -1;
 		} else {
 			/* Currently focused on an empty display */
-			dpy = list_find(wm_tag->dpys, wm_dpy);
+			dpy = &wm_dpy->link;
 		}
-		if (ncol == NULL) {
+		if (ncol < 0) {
 			/* Moving focus to a different display */
-			ndpy = get_next(dpy, cols > 0);
-			ncol = cols > 0 ? DPY(ndpy)->cols :
-				list_last(DPY(ndpy)->cols);
-			wm_dpy = ndpy->data;
+			ndpy = get_next(&wm_tag->dpys, dpy, cols > 0);
+			ncol = cols > 0 ? 0 : DPY(ndpy)->ncols-1;
+			wm_dpy = DPY(ndpy);
 		}
-		if (ncol && COL(ncol) && COL(ncol)->row)
-			set_focus(COL(ncol)->row->win);
+		row_t *row = ncol >= 0 && ncol < wm_dpy->ncols ?
+			get_row(&wm_dpy->cols[ncol]) : NULL;
+		if (row)
+			set_focus(row->win);
 		else
-			sys_focus(NULL);
+			send_focus(NULL);
 	}
 }
 
 /* Raise the window in the floating */
 static void raise_float(win_t *win)
 {
-	printf("raise_float: %p\n", win);
-	list_t *cur;
-	for (cur = wm_dpy->flts; cur; cur = cur->next)
-		if (FLT(cur)->win == win)
-			break;
-	if (cur) {
-		flt_t *flt = cur->data;
-		wm_dpy->flts = list_remove(wm_dpy->flts, cur, 0);
-		wm_dpy->flts = list_append(wm_dpy->flts, flt);
+	debug(LOG_WM, "raise_float: %p\n", win);
+	link_t *ldpy, *lflt;
+	if (FLOATING != searchl(wm_tag, win, &ldpy, NULL, NULL, &lflt))
+		return;
+	if (DPY(ldpy) == wm_dpy && lflt->next) {
+		chain_remove(&wm_dpy->flts, lflt);
+		chain_append(&wm_dpy->flts, lflt);
 		sys_raise(win);
 	}
 }
@@ -525,9 +772,10 @@ static void raise_float(win_t *win)
 /* Toggle between floating and tiling layers */
 static void switch_layer(void)
 {
-	printf("switch_float: %p %d\n",
+	debug(LOG_WM, "switch_float: %p %d\n",
 			wm_dpy, wm_dpy->layer);
 	wm_dpy->layer = !wm_dpy->layer;
+	wm_dpy->dirty = 1;
 	wm_update();
 }
 
@@ -535,43 +783,85 @@ static void switch_layer(void)
 static void set_layer(win_t *win)
 {
 	if (!win) return;
-	printf("set_float: %p %p\n", wm_dpy, win);
+	debug(LOG_WM, "set_float: %p %p\n", wm_dpy, win);
 	wm_dpy->layer = !cut_win(win, wm_tag);
 	put_win(win, wm_tag, wm_dpy->layer);
 	wm_update();
 }
 
+/* Get the digit for single digit tag names, or -1 */
+static int tag_digit(const char *name)
+{
+	return '0' <= name[0] && name[0] <= '9' && !name[1]
+		? name[0] - '0' : -1;
+}
+
 /* Allocate a new tag */
 static tag_t *tag_new(list_t *screens, const char *name)
 {
-	tag_t *tag = new0(tag_t);
-	strncpy(tag->name, name, sizeof(tag->name));
+	tag_t *tag = pool_get(&pool_tag);
+	strncpy(tag->name, name, sizeof(tag->name)-1);
+	tag->hash = hash_str(tag->name);
 	for (list_t *cur = screens; cur; cur = cur->next) {
-		dpy_t *dpy  = new0(dpy_t);
+		dpy_t *dpy  = pool_get(&pool_dpy);
 		dpy->geom = cur->data;
-		tag->dpys = list_append(tag->dpys, dpy);
+		dpy->col  = -1;
+		chain_append(&tag->dpys, &dpy->link);
 	}
-	tag->dpy  = tag->dpys->data;
-	for (list_t *dpy = tag->dpys; dpy; dpy = dpy->next)
-		if (DPY(dpy)->geom->z > tag->dpy->geom->z)
-			tag->dpy = dpy->data;
+	tag->dpy  = DPY(tag->dpys.head);
+	chain_foreach(&tag->dpys, dpy, dpy_t, link)
+		if (dpy->geom->z > tag->dpy->geom->z)
+			tag->dpy = dpy;
 	return tag;
 }
 
+/* Add a tag to the tag list and lookup tables */
+static void tag_add(tag_t *tag)
+{
+	chain_t *bucket = &wm->index[tag->hash % countof(wm->index)];
+	int      digit  = tag_digit(tag->name);
+	chain_append(&wm->tags, &tag->link);
+	chain_insert(bucket, bucket->head, &tag->bucket);
+	if (digit >= 0)
+		wm->digit[digit] = tag;
+}
+
+/* Remove a tag from the tag list and lookup tables and free it */
+static void tag_del(tag_t *tag)
+{
+	chain_t *bucket = &wm->index[tag->hash % countof(wm->index)];
+	int      digit  = tag_digit(tag->name);
+	if (digit >= 0)
+		wm->digit[digit] = NULL;
+	chain_remove(bucket,    &tag->bucket);
+	chain_remove(&wm->tags, &tag->link);
+	pool_put(&pool_tag, tag);
+}
+
 /* Search for a tag
  *   If it does not exist it is based on the
  *   display geometry in wm->screens */
 static tag_t *tag_find(const char *name)
 {
-	tag_t *tag = NULL;
-	for (list_t *cur = wm->tags; cur; cur = cur->next)
-		if (!strcmp(name, TAG(cur)->name)) {
-			tag = cur->data;
-			break;
-		}
+	/* Names are cut to fit, the same as in tag_new */
+	tag_t *tag   = NULL;
+	char   key[sizeof(tag->name)] = {};
+	strncpy(key, name, sizeof(key)-1);
+	int    digit = tag_digit(key);
+	if (digit >= 0) {
+		tag = wm->digit[digit];
+	} else {
+		unsigned hash = hash_str(key);
+		chain_foreach(&wm->index[hash % countof(wm->index)],
+				cur, tag_t, bucket)
+			if (cur->hash == hash && !strcmp(key, cur->name)) {
+				tag = cur;
+				break;
+			}
+	}
 	if (!tag) {
-		tag = tag_new(wm->screens, name);
-		wm->tags = list_append(wm->tags, tag);
+		tag = tag_new(wm->screens, key);
+		tag_add(tag);
 	}
 	return tag;
 }
@@ -580,135 +870,313 @@ static tag_t *tag_find(const char *name)
  *   Unlike wmii, only remove the current tag, not all tags */
 static void tag_set(win_t *win, const char *name)
 {
-	printf("tag_set: %p %s\n", win, name);
-	if (!strcmp(wm_tag->name, name))
-		return;
+	debug(LOG_WM, "tag_set: %p %s\n", win, name);
 	tag_t *tag = tag_find(name);
+	if (tag == wm_tag)
+		return;
 	layer_t layer = cut_win(win, wm_tag);
 	put_win(win, tag, layer);
+	hide_win(win);
+	win->wm->frame.state = ST_HIDE;
+	win->wm->frame.h     = -1;
 	set_focus(wm_focus);
 }
 
-/* Switch to a different tag */
+/* Move a window left on another display of a tag that is being
+ * removed onto the matching display of the new tag */
+static void tag_keep(win_t *win, tag_t *tag, dpy_t *from, layer_t layer)
+{
+	chain_foreach(&tag->dpys, dpy, dpy_t, link) {
+		if (dpy->geom != from->geom)
+			continue;
+		dpy_t *focus = tag->dpy;
+		if (layer == TILING)
+			put_win_col(win, tag, dpy, dpy->col);
+		if (layer == FLOATING)
+			put_win_flt(win, tag, dpy);
+		tag->dpy = focus;
+		return;
+	}
+}
+
+/* Switch to a different tag
+ *   The old tag is removed when the focused display is empty */
 static void tag_switch(const char *name)
 {
-	printf("tag_switch: %s\n", name);
-	tag_t *old = wm_tag;
-	if ((wm_col == NULL || wm_row == NULL) && wm_flt == NULL) {
-		while (old->dpys) {
-			dpy_t *dpy = old->dpys->data;
-			while (dpy->cols)
-				dpy->cols = list_remove(dpy->cols, dpy->cols, 1);
-			old->dpys = list_remove(old->dpys, old->dpys, 1);
+	debug(LOG_WM, "tag_switch: %s\n", name);
+	tag_t *old   = wm_tag;
+	int    empty = wm_row == NULL && wm_flt == NULL;
+	wm_tag = tag_find(name);
+	if (old == wm_tag)
+		return;
+	if (empty) {
+		tag_foreach_col(old, dpy, col, row, win)
+			tag_keep(win, wm_tag, DPY(dpy), TILING);
+		tag_foreach_flt(old, dpy, flt, win)
+			tag_keep(win, wm_tag, DPY(dpy), FLOATING);
+		while (old->dpys.head) {
+			dpy_t *dpy = DPY(old->dpys.head);
+			chain_remove(&old->dpys, &dpy->link);
+			col_free(dpy);
+			pool_put(&pool_dpy, dpy);
 		}
-		list_t *ltag = list_find(wm->tags, old);
-		wm->tags = list_remove(wm->tags, ltag, 1);
+		tag_del(old);
+		old = NULL;
+	}
+	wm->hide = old;
+	wm->show = wm_tag;
+	chain_foreach(&wm_tag->dpys, dpy, dpy_t, link)
+		dpy->restack = 1;
+}
+
+/* Add a frame for the window to the current update */
+static void put_frame(win_t *win, state_t state, int move,
+		int x, int y, int w, int h)
+{
+	if (nframes == sframes) {
+		sframes = MAX(sframes*2, 16);
+		frames  = realloc(frames, sizeof(frame_t)*sframes);
+	}
+	frames[nframes++] = (frame_t){win, x, y, w, h, move, state};
+}
+
+/* Re-emit a column of a tag that is being shown again
+ *   Frames are kept while a tag is hidden, so a column that was
+ *   not invalidated meanwhile is queued from its last frames and
+ *   only maps the windows. Windows that were not plain shown may
+ *   have had their size changed by the system so they are always
+ *   moved */
+static void wm_reshow_col(col_t *col, int clean)
+{
+	for (int r = 0; r < col->nrows; r++) {
+		row_t   *row   = &col->rows[r];
+		frame_t *frame = &row->win->wm->frame;
+		if (clean)
+			put_frame(row->win, frame->state, row->state == ST_SHOW,
+				frame->x, frame->y, frame->w, frame->h);
+		if (frame->state != ST_SHOW)
+			frame->h = -1;
+		frame->state = ST_HIDE;
 	}
-	wm_tag = tag_find(name);
 }
 
 /* Tile all windows in the given display
- *   This performs all the actual window tiling
- *   Currently supports  split, stack and maximized modes */
-static void wm_update_cols(dpy_t *dpy)
+ *   This computes the window tiling into frames and does not
+ *   call into the system. Currently supports split, stack
+ *   and maximized modes. Only dirty columns are laid out,
+ *   unless the whole display is dirty */
+static void wm_layout_cols(dpy_t *dpy)
 {
 	int  x=0,  y=0; // Current window top-left position
-	int tx=0, ty=0; // Total size (sum of initial col widths and row heights w/o margin)
 	int mx=0, my=0; // Maximum usable size (screen size minus margins)
 	int       sy=0; // Stack size (height of focused stack window)
 
-	float rx=0, ry=0; // Residuals for floating point round off
-
-	/* Scale horizontally */
+	/* Scale horizontally
+	 *   Any change in width moves every column */
 	x  = dpy->geom->x;
-	mx = dpy->geom->w - (list_length(dpy->cols)+1)*margin;
-	for (list_t *lcol = dpy->cols; lcol; lcol = lcol->next)
-		tx += COL(lcol)->width;
-	for (list_t *lcol = dpy->cols; lcol; lcol = lcol->next)
-		COL(lcol)->width = residual(COL(lcol)->width * (float)mx/tx, &rx);
+	mx = dpy->geom->w - (dpy->ncols+1)*margin;
+	if (distribute(dpy->widths, dpy->widths, dpy->ncols, mx))
+		dpy->dirty = 1;
 
 	/* Scale each column vertically */
-	win_t *focus = get_focus();
-	for (list_t *lcol = dpy->cols; lcol; lcol = lcol->next) {
-		col_t *col = lcol->data;
-		int nrows = list_length(col->rows);
-		ty = 0;
-		for (list_t *lrow = col->rows; lrow; lrow = lrow->next)
-			ty += ROW(lrow)->height;
+	for (int c = 0; c < dpy->ncols; c++) {
+		col_t *col   = &dpy->cols[c];
+		int    width = dpy->widths[c];
+		int    clean = !col->dirty && !dpy->dirty;
+		if (dpy->reshow)
+			wm_reshow_col(col, clean);
+		if (clean) {
+			x += width + margin;
+			continue;
+		}
+		col->dirty = 0;
+		int nrows = col->nrows;
 		y  = dpy->geom->y;
 		my = dpy->geom->h - (margin + (nrows-1)* margin    + margin);
 		sy = dpy->geom->h - (margin + (nrows-1)*(margin/2) + margin)
 		                  -           (nrows-1)* stack;
-		for (list_t *lrow = col->rows; lrow; lrow = lrow->next) {
-			win_t *win = ROW(lrow)->win;
-			if (ROW(lrow)->state != ST_SHOW) {
-				sys_show(win, ROW(lrow)->state);
+		if (col->layout == SPLIT)
+			distribute(col->heights, col->heights, nrows, my);
+		for (int r = 0; r < nrows; r++) {
+			row_t *row = &col->rows[r];
+			if (row->state != ST_SHOW) {
+				put_frame(row->win, row->state, 0, 0, 0, 0, 0);
 				continue;
 			}
-			win->h = ROW(lrow)->height;
-			state_t state = ST_SHOW;
+			int h = 0;
 			switch (col->layout) {
 			case SPLIT:
-				sys_move(win, x+margin, y+margin, col->width,
-					residual(win->h * ((float)my/ty), &ry));
-				y += win->h + margin;
+				h = col->heights[r];
+				put_frame(row->win, ST_SHOW, 1,
+					x+margin, y+margin, width, h);
+				y += h + margin;
 				break;
 			case STACK:
-				if (lrow->next && ROW(lrow->next)->win == col->row->win) {
-					/* Hack to prevent flashing */
-					win_t *next = ROW(lrow->next)->win;
-					sys_move(next, x+margin, y+margin+stack+margin/2,
-						col->width, sy);
-					sys_show(next, ST_SHOW);
-				}
-				int isfocus = win == col->row->win;
-				state  = isfocus ? ST_SHOW : ST_SHADE;
-				sys_show(win, state);
-				sys_move(win, x+margin, y+margin, col->width, sy);
+				h = sy;
+				int isfocus = r == col->row;
+				put_frame(row->win, isfocus ? ST_SHOW : ST_SHADE, 1,
+					x+margin, y+margin, width, h);
 				y += (isfocus ? sy : stack) + (margin/2);
 				break;
 			case FULL:
 			case TAB:
-				sys_move(win, x+margin, 0+margin,
-					col->width, dpy->geom->h-2*margin);
+				h = dpy->geom->h-2*margin;
+				put_frame(row->win, ST_SHOW, 1,
+					x+margin, 0+margin, width, h);
 				break;
 			}
-			sys_show(win, state);
-			if (focus == win)
-				sys_raise(win);
-			ROW(lrow)->height = win->h;
+			col->heights[r] = h;
 		}
-		x += col->width + margin;
+		x += width + margin;
 	}
+	dpy->reshow = 0;
+}
+
+/* Send the frames to the system
+ *   Only changes from the last frame of each window are sent.
+ *   Windows are moved before they are shown or shaded so that
+ *   nothing is visible at it's old position. Returns the number
+ *   of windows changed */
+static int wm_emit_frames(dpy_t *dpy)
+{
+	int changed = 0;
+	win_t *focus = get_focus();
+
+	for (int i = 0; i < nframes; i++) {
+		frame_t *next = &frames[i];
+		frame_t *prev = &next->win->wm->frame;
+		int moved = next->move && (
+			next->x != prev->x || next->y != prev->y ||
+			next->w != prev->w || next->h != prev->h ||
+			(next->state != prev->state && prev->state != ST_HIDE));
+		if (moved)
+			sys_move(next->win, next->x, next->y, next->w, next->h);
+		next->move = moved;
+	}
+
+	for (int i = 0; i < nframes; i++) {
+		frame_t *next = &frames[i];
+		frame_t *prev = &next->win->wm->frame;
+		int shown = next->state != prev->state;
+		if (shown)
+			sys_show(next->win, next->state);
+		if (next->win == focus && focus != dpy->top) {
+			sys_raise(next->win);
+			dpy->top     = focus;
+			dpy->restack = 1;
+		}
+		changed += next->move || shown;
+		*prev = *next;
+	}
+
+	nframes = 0;
+	return changed;
+}
+
+/* Prepare a display that is being shown again
+ *   Floating windows are diffed against frames marked hidden,
+ *   columns are handled by wm_reshow_col during the layout */
+static void wm_show_dpy(dpy_t *dpy)
+{
+	chain_foreach(&dpy->flts, flt, flt_t, link)
+		flt->win->wm->frame.state = ST_HIDE;
+	dpy->reshow = 1;
+}
+
+/* Update window sizes on a single display
+ *   Floating windows are only moved or shown when they differ
+ *   from their last frame, and are raised in stacking order when
+ *   the order changed or a tiled window was raised over them.
+ *   Returns the number of windows touched */
+static int wm_update_dpy(dpy_t *dpy, int *changed)
+{
+	wm_layout_cols(dpy);
+	int touched = nframes;
+	*changed += wm_emit_frames(dpy);
+	if (dpy->dirty)
+		dpy->restack = 1;
+	chain_foreach(&dpy->flts, flt, flt_t, link) {
+		frame_t *prev = &flt->win->wm->frame;
+		int moved = flt->x != prev->x || flt->y != prev->y ||
+			    flt->w != prev->w || flt->h != prev->h;
+		int shown = flt->state != prev->state;
+		if (moved)
+			sys_move(flt->win, flt->x, flt->y, flt->w, flt->h);
+		if (dpy->restack)
+			sys_raise(flt->win);
+		if (shown)
+			sys_show(flt->win, flt->state);
+		*prev = (frame_t){flt->win, flt->x, flt->y,
+			flt->w, flt->h, 0, flt->state};
+		touched  += moved || shown || dpy->restack;
+		*changed += moved || shown;
+	}
+	dpy->restack = 0;
+	dpy->dirty   = 0;
+	return touched;
 }
 
 /* Refresh the window layout */
 void wm_update(void)
 {
-	/* Updates window sizes */
-	for (list_t *ldpy = wm_tag->dpys; ldpy; ldpy = ldpy->next)
-		wm_update_cols(ldpy->data);
-	tag_foreach_flt(wm_tag, ldpy, lflt, win) {
-		flt_t *flt = lflt->data;
-		sys_move(win, flt->x, flt->y, flt->w, flt->h);
-		sys_raise(flt->win);
-		sys_show(flt->win, flt->state);
-	}
-
-	/* Hide other tags */
-	for (list_t *tag = wm ->tags; tag; tag = tag->next)
-		if (tag->data != wm_tag) {
-			tag_foreach_col(TAG(tag), dpy, col, row, win)
-				sys_show(win, ST_HIDE);
-			tag_foreach_flt(TAG(tag), dpy, flt, win)
-				sys_show(win, ST_HIDE);
-		}
+	int touched = 0, changed = 0;
+
+	/* Updates window sizes
+	 *   When switching tags the new tag is still unmapped here,
+	 *   its windows are configured and then mapped before the
+	 *   previous tag is hidden below */
+	chain_foreach(&wm_tag->dpys, dpy, dpy_t, link) {
+		if (wm_tag->dirty)
+			dpy->dirty = 1;
+		if (wm->show == wm_tag)
+			wm_show_dpy(dpy);
+		touched += wm_update_dpy(dpy, &changed);
+	}
+	wm_tag->dirty = 0;
+	wm->show = NULL;
+	debug(LOG_DUMP, "wm_update: %d windows touched, %d changed\n",
+			touched, changed);
+	ring_put(RING_UPDATE, 0, touched, changed, 0, 0);
+
+	/* Hide the previous tag
+	 *   Windows in other tags are already hidden,
+	 *   frames are left as they were for showing it again */
+	if (wm->hide) {
+		tag_foreach_col(wm->hide, dpy, col, row, win)
+			hide_win(win);
+		tag_foreach_flt(wm->hide, dpy, flt, win)
+			hide_win(win);
+		wm->hide = NULL;
+	}
 
 	/* Set focused window */
 	if (wm_focus)
 		set_focus(wm_focus);
 }
 
+/* Relayout the columns being resized by a drag
+ *   Only the dirty columns are laid out, at most rate times per
+ *   second. Motions in between are laid out from a timer so the
+ *   layout catches up when the pointer stops */
+static void drag_update(void)
+{
+	link_t *ldpy;
+	if (move_mode != RESIZE || move_layer != TILING ||
+	    TILING != searchl(wm_tag, move_win, &ldpy, NULL, NULL, NULL))
+		return;
+	long long now  = get_nsec();
+	long long wait = rate > 0 ? move_time + 1000000000LL/rate - now : 0;
+	if (wait > 0) {
+		if (!move_timer)
+			sys_timer((wait + 999999) / 1000000);
+		move_timer = 1;
+		return;
+	}
+	move_time = now;
+	int changed = 0;
+	wm_update_dpy(DPY(ldpy), &changed);
+}
+
 /*******************************
  * Window management functions *
  *******************************/
@@ -752,7 +1220,7 @@ int wm_handle_event(win_t *win, event_t ev, mod_t mod, ptr_t ptr)
 	}
 #endif
 	if (mod.MODKEY) {
-		if (ev == EV_F5) return wm_update(),    1;
+		if (ev == EV_F5) return wm_tag->dirty = 1, wm_update(), 1;
 		if (ev == EV_F6) return print_txt(),    1;
 		if (ev == 'q')   return sys_exit(),     1;
 	}
@@ -808,11 +1276,15 @@ int wm_handle_event(win_t *win, event_t ev, mod_t mod, ptr_t ptr)
 	/* Tag switching */
 	if (mod.MODKEY && '0' <= ev && ev <= '9') {
 		char name[] = {ev, '\0'};
+		long long start = get_nsec();
 		if (win && mod.shift)
 			tag_set(win, name);
 		if (!mod.shift)
 			tag_switch(name);
 		wm_update();
+		long long time = (get_nsec()-start)/1000;
+		debug(LOG_DUMP, "tag %s: %lld us\n", name, time);
+		ring_put(RING_TAG, 0, ev, time, 0, 0);
 	}
 
 	/* Focus change */
@@ -822,8 +1294,11 @@ int wm_handle_event(win_t *win, event_t ev, mod_t mod, ptr_t ptr)
 	/* Reset focus after after focus change,
 	 * not sure what is causing the focus change in the first place
 	 * but preventing that would be a better solution */
-	if (ev == EV_FOCUS)
+	if (ev == EV_FOCUS) {
+		wm->focus = wm_focus;
+		wm->focused++;
 		sys_focus(wm_focus);
+	}
 
 	return mod.MODKEY;
 }
@@ -840,22 +1315,34 @@ int wm_handle_ptr(win_t *cwin, ptr_t ptr)
 	int dy = ptr.ry - move_prev.ry;
 	move_prev = ptr;
 
+	/* Columns and rows may have changed since the drag started */
+	link_t *ldpy, *lflt;
+	int c, r;
+	if (move_layer != searchl(wm_tag, move_win, &ldpy, &c, &r, &lflt))
+		return 0;
+
 	if (move_layer == TILING && move_mode == RESIZE) {
-		list_t *vert = move_dir.v < 0 ? move_lrow->prev : move_lrow->next;
-		list_t *horz = move_dir.h < 0 ? move_lcol->prev : move_lcol->next;
-		if (vert) {
-			ROW(move_lrow)->height += move_dir.v * dy;
-			ROW(vert)->height      -= move_dir.v * dy;
+		dpy_t *dpy  = DPY(ldpy);
+		col_t *col  = &dpy->cols[c];
+		int    vert = r + (move_dir.v < 0 ? -1 : +1);
+		int    horz = c + (move_dir.h < 0 ? -1 : +1);
+		if (0 <= vert && vert < col->nrows) {
+			col->heights[r]    += move_dir.v * dy;
+			col->heights[vert] -= move_dir.v * dy;
+			col->dirty          = 1;
 		}
-		if (horz) {
-			COL(move_lcol)->width  += move_dir.h * dx;
-			COL(horz)->width       -= move_dir.h * dx;
+		if (0 <= horz && horz < dpy->ncols) {
+			dpy->widths[c]        += move_dir.h * dx;
+			dpy->widths[horz]     -= move_dir.h * dx;
+			dpy->cols[c].dirty    = 1;
+			dpy->cols[horz].dirty = 1;
 		}
-		wm_update();
+
+		drag_update();
 	}
 
 	if (move_layer == FLOATING) {
-		flt_t *flt = move_lflt->data;
+		flt_t *flt = FLT(lflt);
 		win_t *win = flt->win;
 		if (move_mode == MOVE)
 			sys_move(win, win->x+dx, win->y+dy, win->w, win->h);
@@ -867,6 +1354,8 @@ int wm_handle_ptr(win_t *cwin, ptr_t ptr)
 				win->h + dy *  move_dir.v);
 		flt->x = win->x; flt->y = win->y;
 		flt->w = win->w; flt->h = win->h;
+		win->wm->frame.x = win->x; win->wm->frame.y = win->y;
+		win->wm->frame.w = win->w; win->wm->frame.h = win->h;
 	}
 
 	return 0;
@@ -874,19 +1363,21 @@ int wm_handle_ptr(win_t *cwin, ptr_t ptr)
 
 int wm_handle_state(win_t *win, state_t prev, state_t next)
 {
+	dpy_t *dpy = NULL;
+	col_t *col = NULL;
 	row_t *row = NULL;
 	flt_t *flt = NULL;
 
-	printf("wm_handle_state - %p %x -> %x\n", win, prev, next);
+	debug(LOG_WM, "wm_handle_state - %p %x -> %x\n", win, prev, next);
 
-	search(wm_tag, win, NULL, NULL, &row, &flt);
+	search(wm_tag, win, &dpy, &col, &row, &flt);
 
 	if (!row && !flt && next == ST_SHOW)
 		return wm_insert(win), 1;
 	if ((row || flt) && (next == ST_HIDE || next == ST_ICON))
 		return wm_remove(win), 1;
 
-	if (row) row->state = next;
+	if (row) row->state = next, col->dirty = 1;
 	if (flt) flt->state = next;
 
 	if (prev == ST_MAX || prev == ST_FULL ||
@@ -896,9 +1387,31 @@ int wm_handle_state(win_t *win, state_t prev, state_t next)
 	return 1;
 }
 
+int wm_handle_screen(win_t *screen)
+{
+	debug(LOG_WM, "wm_handle_screen - %p %dx%d @ %d,%d\n", screen,
+			screen->w, screen->h, screen->x, screen->y);
+
+	/* Other tags get relaid out when switching to them */
+	chain_foreach(&wm->tags, tag, tag_t, link)
+		chain_foreach(&tag->dpys, dpy, dpy_t, link)
+			if (dpy->geom == screen)
+				dpy->dirty = 1;
+	wm_update();
+	return 1;
+}
+
+int wm_handle_timer(void)
+{
+	move_timer = 0;
+	drag_update();
+	return 1;
+}
+
 void wm_insert(win_t *win)
 {
-	printf("wm_insert: %p\n", win);
+	debug(LOG_WM, "wm_insert: %p\n", win);
+	ring_put(RING_INSERT, (unsigned long)win, 0, 0, 0, 0);
 
 	/* Make sure it's visible */
 	if (win->state == ST_HIDE)
@@ -906,14 +1419,18 @@ void wm_insert(win_t *win)
 
 	/* Check for toolbars */
 	if (win->type == TYPE_TOOLBAR)
-		return wm_update();
+		return wm_tag->dirty = 1, wm_update();
 
-	print_txt();
+	trace_txt();
 
 	/* Initialize window */
 	sys_watch(win, EV_ENTER, MOD());
 	sys_watch(win, EV_FOCUS, MOD());
 
+	/* Windows can only be in one tag */
+	if (win->wm && win->wm->tag)
+		cut_win(win, win->wm->tag);
+
 	/* Add to screen */
 	if (win->type == TYPE_DIALOG || win->parent)
 		wm_dpy->layer = FLOATING;
@@ -922,34 +1439,44 @@ void wm_insert(win_t *win)
 	/* Arrange */
 	wm_update();
 	set_focus(win);
-	print_txt();
+	trace_txt();
 }
 
 void wm_remove(win_t *win)
 {
-	printf("wm_remove: %p\n", win);
-	print_txt();
+	debug(LOG_WM, "wm_remove: %p\n", win);
+	ring_put(RING_REMOVE, (unsigned long)win, 0, 0, 0, 0);
+	trace_txt();
 	if (win->type == TYPE_TOOLBAR)
-		return wm_update();
-	for (list_t *tag = wm->tags; tag; tag = tag->next)
-		cut_win(win, tag->data);
+		return wm_tag->dirty = 1, wm_update();
+	if (win->wm) {
+		cut_win(win, win->wm->tag);
+		pool_put(&pool_loc, win->wm);
+		win->wm = NULL;
+	}
+	if (wm->focus == win)
+		wm->focus = NULL;
 	set_focus(wm_focus);
 	wm_update();
-	print_txt();
+	trace_txt();
 }
 
 void wm_init(void)
 {
-	printf("wm_init\n");
+	info(LOG_WM, "wm_init\n");
 
 	/* Load configuration */
 	margin = conf_get_int("main.margin", margin);
 	stack  = conf_get_int("main.stack",  stack);
+	rate   = conf_get_int("main.drag-rate", rate);
 
-	wm          = new0(wm_t);
-	wm->screens = list_sort(sys_info(), 0, sort_win);
+	/* Sort a copy, the screen list belongs to the sys */
+	wm = new0(wm_t);
+	for (list_t *cur = sys_info(); cur; cur = cur->next)
+		wm->screens = list_insert(wm->screens, cur->data);
+	wm->screens = list_sort(wm->screens, 0, sort_win);
 	wm->tag     = tag_new(wm->screens, "1");
-	wm->tags    = list_insert(NULL, wm->tag);
+	tag_add(wm->tag);
 
 	event_t ev_e[] = {EV_ENTER, EV_FOCUS};
 	event_t ev_s[] = {'h', 'j', 'k', 'l', 'c', 'q', ' ',
@@ -971,19 +1498,32 @@ void wm_init(void)
 void wm_free(void)
 {
 	/* Re-show and free all windows */
-	while ( wm->tags) { tag_t *tag =  wm->tags->data;
-	while (tag->dpys) { dpy_t *dpy = tag->dpys->data;
-	while (dpy->cols) { col_t *col = dpy->cols->data;
-	while (col->rows) { row_t *row = col->rows->data;
+	while ( wm->tags.head) { tag_t *tag = TAG( wm->tags.head);
+	while (tag->dpys.head) { dpy_t *dpy = DPY(tag->dpys.head);
+	for (int c = 0; c < dpy->ncols; c++) { col_t *col = &dpy->cols[c];
+	for (int r = 0; r < col->nrows; r++) { row_t *row = &col->rows[r];
 		sys_show(row->win, ST_SHOW);
-	col->rows = list_remove(col->rows, col->rows, 1); }
-	dpy->cols = list_remove(dpy->cols, dpy->cols, 1); }
-	while (dpy->flts) { flt_t *flt = dpy->flts->data;
+		pool_put(&pool_loc, row->win->wm); row->win->wm = NULL; } }
+	col_free(dpy);
+	while (dpy->flts.head) { flt_t *flt = FLT(dpy->flts.head);
 		sys_show(flt->win, ST_SHOW);
-	dpy->flts = list_remove(dpy->flts, dpy->flts, 1); }
-	tag->dpys = list_remove(tag->dpys, tag->dpys, 1); }
-	 wm->tags = list_remove( wm->tags,  wm->tags, 1); }
+		pool_put(&pool_loc, flt->win->wm); flt->win->wm = NULL;
+	chain_remove(&dpy->flts, &flt->link); pool_put(&pool_flt, flt); }
+	chain_remove(&tag->dpys, &dpy->link); pool_put(&pool_dpy, dpy); }
+	tag_del(tag); }
 
 	/* Free remaining data */
+	pool_free(&pool_tag);
+	pool_free(&pool_dpy);
+	pool_free(&pool_flt);
+	pool_free(&pool_loc);
+	while (wm->screens)
+		wm->screens = list_remove(wm->screens, wm->screens, 0);
+	free(frames);
+	frames  = NULL;
+	nframes = sframes = 0;
+	move_mode  = NONE;
+	move_win   = NULL;
+	move_timer = 0;
 	free(wm);
 }
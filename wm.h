@@ -31,6 +31,12 @@ int wm_handle_ptr(win_t *win, ptr_t ptr);
 /* Called when a window changes states */
 int wm_handle_state(win_t *win, state_t prev, state_t next);
 
+/* Called when the usable area of a screen changes */
+int wm_handle_screen(win_t *screen);
+
+/* Called when the timer set by sys_timer expires */
+int wm_handle_timer(void);
+
 /* Begin managing a window, called for each new window */
 void wm_insert(win_t *win);
 
@@ -0,0 +1,844 @@
+/*
+ * Copyright (c) 2011, Andy Spencer <andy753421@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ */
+
+/* Unit tests and benchmarks
+ *   `wmpus-test` runs the tests and exits non-zero on failure,
+ *   `wmpus-test bench` runs the benchmarks instead */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "conf.h"
+#include "types.h"
+#include "sys.h"
+#include "wm.h"
+#include "x11.h"
+
+/* Helpers */
+static int failed;
+
+#define check(cond) do {                                   \
+	if (!(cond)) {                                     \
+		printf("%s:%d: %s: check failed: %s\n",    \
+			__FILE__, __LINE__, __func__, #cond); \
+		failed++;                                  \
+	}                                                  \
+} while (0)
+
+static void report(const char *name, int n, long long start)
+{
+	long long time = get_nsec() - start;
+	printf("%-24s %8d ops %10.1f us %8.1f ns/op\n",
+			name, n, time / 1E3, (double)time / n);
+}
+
+/* Containers */
+#define int_eq(a, b)  ((a) == (b))
+#define low_hash(key) (14 + (key) / 100)
+
+HASHMAP(imap, int, int, hash_int, int_eq)
+HASHMAP(wrap, int, int, low_hash, int_eq)
+
+static void test_hash_put_get(void)
+{
+	imap_t map = {};
+	check(imap_get(&map, 1) == NULL);
+	check(imap_del(&map, 1) == 0);
+	for (int i = 0; i < 100; i++)
+		*imap_put(&map, i, i) *= 2;
+	check(map.length == 100);
+	for (int i = 0; i < 100; i++)
+		check(imap_get(&map, i) && *imap_get(&map, i) == i*2);
+	imap_put(&map, 7, -1);
+	check(map.length == 100);
+	check(*imap_get(&map, 7) == -1);
+	check(imap_get(&map, 100) == NULL);
+	int count = 0;
+	hash_foreach(&map, slot)
+		count++;
+	check(count == 100);
+	imap_free(&map);
+	check(map.slots == NULL && map.length == 0 && map.size == 0);
+}
+
+static void test_hash_grow(void)
+{
+	/* Tables start at 16 and double past a 3/4 load */
+	imap_t map = {};
+	for (int i = 0; i < 12; i++)
+		imap_put(&map, i, i);
+	check(map.size == 16);
+	imap_put(&map, 12, 12);
+	check(map.size == 32);
+	for (int i = 0; i < 24; i++)
+		imap_put(&map, i, i);
+	check(map.size == 32);
+	imap_put(&map, 24, 24);
+	check(map.size == 64);
+	check(map.length == 25);
+	for (int i = 0; i < 25; i++)
+		check(imap_get(&map, i) && *imap_get(&map, i) == i);
+	imap_free(&map);
+}
+
+static void test_hash_wrap(void)
+{
+	/* Keys below 100 hash to slot 14, keys from 100 to slot 15,
+	 * so the probe runs wrap around the end of the table */
+	wrap_t map = {};
+	int keys[] = {0, 1, 2, 3, 100};
+	for (int i = 0; i < countof(keys); i++)
+		wrap_put(&map, keys[i], i);
+	check(map.size == 16);
+	check(map.slots[14].key == 0 && map.slots[15].key == 1);
+	check(map.slots[0].key  == 2 && map.slots[1].key  == 3);
+	check(map.slots[2].key  == 100);
+
+	/* Deleting the head of the run shifts everything back
+	 * across the wrap, including 100 which lives past its home */
+	check(wrap_del(&map, 0));
+	check(map.length == 4);
+	check(map.slots[14].key == 1 && map.slots[15].key == 2);
+	check(map.slots[0].key  == 3 && map.slots[1].key  == 100);
+	check(!map.slots[2].used);
+	for (int i = 1; i < countof(keys); i++)
+		check(wrap_get(&map, keys[i]) && *wrap_get(&map, keys[i]) == i);
+	check(wrap_get(&map, 0) == NULL);
+
+	/* A key in its home slot stays put */
+	check(wrap_del(&map, 2));
+	check(map.slots[14].key == 1 && map.slots[15].key == 3);
+	check(map.slots[0].key  == 100 && !map.slots[1].used);
+	check(wrap_del(&map, 1) && wrap_del(&map, 3) && wrap_del(&map, 100));
+	check(map.length == 0);
+	for (int i = 0; i < map.size; i++)
+		check(!map.slots[i].used);
+	wrap_free(&map);
+}
+
+static void test_hash_random(void)
+{
+	/* Compare against a plain array */
+	int ref[512] = {};
+	imap_t map = {};
+	srand(1);
+	for (int n = 0; n < 100000; n++) {
+		int key = rand() % countof(ref);
+		switch (rand() % 3) {
+		case 0:
+			imap_put(&map, key, n);
+			ref[key] = n+1;
+			break;
+		case 1:
+			check(imap_del(&map, key) == !!ref[key]);
+			ref[key] = 0;
+			break;
+		case 2: {
+			int *val = imap_get(&map, key);
+			check((val ? *val+1 : 0) == ref[key]);
+		} }
+	}
+	imap_free(&map);
+}
+
+static void test_hash_str(void)
+{
+	check(hash_str("") == 2166136261u);
+	check(hash_str("a") != hash_str("b"));
+	check(hash_int(1) != hash_int(2));
+}
+
+static void test_vector(void)
+{
+	VECTOR(int) vec = {};
+	for (int i = 0; i < 100; i++)
+		check(*vec_push(&vec, i) == i);
+	check(vec.length == 100);
+	check(vec.size   == 128);
+	for (int i = 0; i < 100; i++)
+		check(vec.items[i] == i);
+
+	/* Deleting moves the last item into the hole */
+	vec_del(&vec, 10);
+	check(vec.length == 99);
+	check(vec.items[10] == 99);
+	vec_del(&vec, vec.length-1);
+	check(vec.length == 98);
+	check(vec.items[97] == 97);
+
+	int sum = 0;
+	vec_foreach(&vec, item)
+		sum += *item;
+	check(sum == 4950 - 10 - 98);
+	vec_free(&vec);
+	check(vec.items == NULL && vec.length == 0 && vec.size == 0);
+}
+
+static void bench_hash(void)
+{
+	int n = 100000;
+	imap_t map = {};
+	long long start = get_nsec();
+	for (int i = 0; i < n; i++)
+		imap_put(&map, i, i);
+	report("hash put", n, start);
+
+	start = get_nsec();
+	int found = 0;
+	for (int i = 0; i < n; i++)
+		found += imap_get(&map, i) != NULL;
+	report("hash get", n, start);
+
+	start = get_nsec();
+	for (int i = n; i < 2*n; i++)
+		found += imap_get(&map, i) != NULL;
+	report("hash get (missing)", n, start);
+
+	start = get_nsec();
+	for (int i = 0; i < n; i++)
+		imap_del(&map, i);
+	report("hash del", n, start);
+	imap_free(&map);
+	check(found == n);
+}
+
+static void bench_vector(void)
+{
+	int n = 1000000;
+	VECTOR(int) vec = {};
+	long long start = get_nsec();
+	for (int i = 0; i < n; i++)
+		vec_push(&vec, i);
+	report("vector push", n, start);
+	vec_free(&vec);
+}
+
+/* Lists */
+typedef struct {
+	int key;
+	int seq;
+} item_t;
+
+static int item_cmp(void *_a, void *_b)
+{
+	item_t *a = _a, *b = _b;
+	return a->key > b->key ?  1 :
+	       a->key < b->key ? -1 : 0;
+}
+
+static list_t *item_list(item_t *items, int n, int keys)
+{
+	list_t *list = NULL;
+	for (int i = n-1; i >= 0; i--) {
+		items[i] = (item_t){rand() % keys, i};
+		list = list_insert(list, &items[i]);
+	}
+	return list;
+}
+
+static void item_check(list_t *list, int n, int rev)
+{
+	/* Sorted by key, equal keys keep their original order */
+	int count = 0;
+	for (list_t *cur = list; cur; cur = cur->next, count++) {
+		if (count == 0)
+			check(cur->prev == NULL);
+		else
+			check(cur->prev && cur->prev->next == cur);
+		if (!cur->next)
+			continue;
+		item_t *a = cur->data, *b = cur->next->data;
+		int order = rev ? item_cmp(b, a) : item_cmp(a, b);
+		check(order <= 0);
+		if (order == 0)
+			check(a->seq < b->seq);
+	}
+	check(count == n);
+}
+
+static void test_list_sort(void)
+{
+	int sizes[] = {0, 1, 2, 3, 7, 64, 100, 1000};
+	for (int i = 0; i < countof(sizes); i++)
+	for (int rev = 0; rev < 2; rev++) {
+		int     n     = sizes[i];
+		item_t *items = calloc(n+1, sizeof(item_t));
+		list_t *list  = item_list(items, n, n/4+1);
+		list = list_sort(list, rev, item_cmp);
+		item_check(list, n, rev);
+		while (list)
+			list = list_remove(list, list, 0);
+		free(items);
+	}
+}
+
+static void test_list_sort_equal(void)
+{
+	/* All keys equal, the order must not change at all */
+	item_t  items[50];
+	list_t *list = item_list(items, countof(items), 1);
+	list = list_sort(list, 0, item_cmp);
+	int seq = 0;
+	for (list_t *cur = list; cur; cur = cur->next)
+		check(((item_t*)cur->data)->seq == seq++);
+	list = list_sort(list, 1, item_cmp);
+	seq = 0;
+	for (list_t *cur = list; cur; cur = cur->next)
+		check(((item_t*)cur->data)->seq == seq++);
+	while (list)
+		list = list_remove(list, list, 0);
+}
+
+static void bench_list_sort(void)
+{
+	int sizes[] = {100, 1000, 10000, 100000};
+	for (int i = 0; i < countof(sizes); i++) {
+		int     n     = sizes[i];
+		item_t *items = calloc(n, sizeof(item_t));
+		list_t *list  = item_list(items, n, n);
+		char    name[32];
+		snprintf(name, sizeof(name), "list_sort %d", n);
+		long long start = get_nsec();
+		list = list_sort(list, 0, item_cmp);
+		report(name, n, start);
+		while (list)
+			list = list_remove(list, list, 0);
+		free(items);
+	}
+}
+
+static void test_pool(void)
+{
+	/* Slab pools malloc once per block and reuse freed items */
+	pool_t pool = SLAB(list_t, 8);
+	list_t *items[20];
+	for (int i = 0; i < 20; i++)
+		items[i] = pool_get(&pool);
+	check(pool.allocs == 3);
+	check(pool.live == 20 && pool.peak == 20);
+	for (int i = 0; i < 20; i++)
+		pool_put(&pool, items[i]);
+	for (int i = 0; i < 20; i++) {
+		items[i] = pool_get(&pool);
+		check(items[i]->data == NULL && items[i]->next == NULL);
+	}
+	check(pool.allocs == 3 && pool.gets == 40);
+	pool_free(&pool);
+}
+
+static void bench_list_churn(void)
+{
+	/* Insert and remove nodes the way the sys code does,
+	 * against plain calloc/free of the same node size */
+	int n = 1000000, depth = 100;
+	int gets = list_pool.gets, allocs = list_pool.allocs;
+	list_t *list = NULL;
+	long long start = get_nsec();
+	for (int i = 0; i < n; i++) {
+		list = list_insert(list, NULL);
+		if (i % depth == depth-1)
+			while (list)
+				list = list_remove(list, list, 0);
+	}
+	report("list churn (pool)", n, start);
+	printf("%-24s %8d nodes %8d mallocs\n", "list churn (pool)",
+			list_pool.gets - gets, list_pool.allocs - allocs);
+
+	list_t *nodes[100];
+	start = get_nsec();
+	for (int i = 0; i < n; i++) {
+		nodes[i % depth] = calloc(1, sizeof(list_t));
+		if (i % depth == depth-1)
+			for (int j = 0; j < depth; j++)
+				free(nodes[j]);
+	}
+	report("list churn (calloc)", n, start);
+}
+
+/* Fake system
+ *   Windows are never drawn, requests are only counted */
+static win_t   screen = {.w = 1000, .h = 800};
+static list_t *screens;
+static int     moves, shows, raises, focuses, timers;
+static int     timer;
+static win_t  *focused, *raised;
+
+void sys_move(win_t *win, int x, int y, int w, int h)
+{
+	win->x = x;  win->y = y;
+	win->w = w;  win->h = h;
+	moves++;
+}
+
+void sys_raise(win_t *win)              { raised = win; raises++; }
+void sys_focus(win_t *win)              { focused = win; focuses++; }
+void sys_show(win_t *win, state_t st)   { win->state = st; shows++; }
+void sys_watch(win_t *win, event_t ev, mod_t mod)   { }
+void sys_unwatch(win_t *win, event_t ev, mod_t mod) { }
+void sys_timer(int msec)                { timer = msec; timers++; }
+void sys_init(void) { }
+void sys_run(void)  { }
+void sys_exit(void) { }
+
+list_t *sys_info(void)
+{
+	if (!screens)
+		screens = list_insert(NULL, &screen);
+	return screens;
+}
+
+void sys_free(void)
+{
+	while (screens)
+		screens = list_remove(screens, screens, 0);
+}
+
+static win_t *wins_new(int n)
+{
+	win_t *wins = calloc(n, sizeof(win_t));
+	for (int i = 0; i < n; i++) {
+		wins[i].w     = 100;
+		wins[i].h     = 100;
+		wins[i].state = ST_SHOW;
+		wm_insert(&wins[i]);
+	}
+	return wins;
+}
+
+/* Window manager */
+static int overlap(win_t *a, win_t *b)
+{
+	return a->x < b->x + b->w && b->x < a->x + a->w &&
+	       a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+static void test_layout(void)
+{
+	/* Two columns of tiles covering the screen */
+	int n = 6, area = 0, cols = 1;
+	wm_init();
+	win_t *wins = wins_new(n);
+	wm_handle_event(&wins[0], 'l', MOD(.alt = 1, .shift = 1), PTR());
+	wm_handle_event(&wins[0], 'h', MOD(.alt = 1), PTR());
+	wm_handle_event(&wins[0], 'l', MOD(.alt = 1, .shift = 1), PTR());
+	for (int i = 0; i < n; i++) {
+		win_t *win = &wins[i];
+		check(win->state == ST_SHOW);
+		check(win->x >= 0 && win->x + win->w <= screen.w);
+		check(win->y >= 0 && win->y + win->h <= screen.h);
+		for (int j = 0; j < i; j++)
+			check(!overlap(win, &wins[j]));
+		cols += win->x != wins[0].x && i == n-1;
+		area += win->w * win->h;
+	}
+	check(cols == 2);
+	check(area == screen.w * screen.h);
+
+	/* Relayout without changes only recomputes frames */
+	int before = moves + shows;
+	wm_handle_event(NULL, EV_F5, MOD(.alt = 1), PTR());
+	check(moves + shows == before);
+	wm_free();
+	free(wins);
+}
+
+static void test_focus(void)
+{
+	/* Focus is only sent when it changes */
+	wm_init();
+	win_t *wins = wins_new(2), *a = &wins[0], *b = &wins[1];
+	check(focused == b);
+	int sent = focuses;
+	wm_handle_event(b, EV_ENTER, MOD(), PTR());
+	wm_handle_event(NULL, EV_F5, MOD(.alt = 1), PTR());
+	check(focuses == sent);
+	wm_handle_event(a, EV_ENTER, MOD(), PTR());
+	check(focused == a && focuses == sent+1);
+
+	/* Round trip through an empty tag */
+	wm_handle_event(NULL, '2', MOD(.alt = 1), PTR());
+	check(a->state == ST_HIDE && b->state == ST_HIDE);
+	sent = focuses;
+	wm_handle_event(NULL, '1', MOD(.alt = 1), PTR());
+	check(a->state == ST_SHOW && b->state == ST_SHOW);
+	check(focused == a && focuses == sent+1);
+
+	/* Shift the focused window to another tag and follow it */
+	wm_handle_event(a, '3', MOD(.alt = 1, .shift = 1), PTR());
+	check(a->state == ST_HIDE && focused == b);
+	wm_handle_event(NULL, '3', MOD(.alt = 1), PTR());
+	check(a->state == ST_SHOW && focused == a);
+	wm_handle_event(NULL, '1', MOD(.alt = 1), PTR());
+	check(focused == b);
+	sent = focuses;
+	wm_handle_event(NULL, '3', MOD(.alt = 1), PTR());
+	check(focused == a && focuses == sent+1);
+
+	/* Shifting the last window away clears the focus */
+	wm_handle_event(a, '4', MOD(.alt = 1, .shift = 1), PTR());
+	check(a->state == ST_HIDE && focused == NULL);
+	wm_handle_event(NULL, '4', MOD(.alt = 1), PTR());
+	check(a->state == ST_SHOW && focused == a);
+	wm_free();
+	free(wins);
+}
+
+static void test_float(void)
+{
+	/* Two tiled windows under three dialogs */
+	int n = 5;
+	win_t *wins = calloc(n, sizeof(win_t));
+	wm_init();
+	for (int i = 0; i < n; i++) {
+		wins[i].w     = 100;
+		wins[i].h     = 100;
+		wins[i].state = ST_SHOW;
+		wins[i].type  = i < 2 ? TYPE_NORMAL : TYPE_DIALOG;
+		wm_insert(&wins[i]);
+	}
+
+	/* Raising the top dialog is a no-op, others raise once */
+	int sent = raises;
+	wm_handle_event(&wins[4], EV_MOUSE1, MOD(), PTR());
+	check(raises == sent);
+	wm_handle_event(&wins[2], EV_MOUSE1, MOD(), PTR());
+	check(raises == sent+1 && raised == &wins[2]);
+	wm_handle_event(&wins[2], EV_MOUSE1, MOD(), PTR());
+	check(raises == sent+1);
+
+	/* Tiling changes leave the dialogs alone */
+	win_t before[3];
+	memcpy(before, &wins[2], sizeof(before));
+	wm_handle_event(&wins[1], EV_ENTER, MOD(), PTR());
+	int moved = moves, shown = shows;
+	wm_handle_event(&wins[1], 'k', MOD(.alt = 1, .shift = 1), PTR());
+	check(moves == moved+2 && shows == shown);
+	check(wins[1].y < wins[0].y);
+	for (int i = 0; i < 3; i++)
+		check(!memcmp(&before[i], &wins[2+i], sizeof(win_t)));
+	wm_free();
+	free(wins);
+}
+
+static void test_drag(void)
+{
+	/* Three columns, a | c | b */
+	wm_init();
+	win_t *wins = wins_new(3), *a = &wins[0], *b = &wins[1], *c = &wins[2];
+	wm_handle_event(c, 'l', MOD(.alt = 1, .shift = 1), PTR());
+	wm_handle_event(b, EV_ENTER, MOD(), PTR());
+	wm_handle_event(b, 'l', MOD(.alt = 1, .shift = 1), PTR());
+	wm_handle_event(b, 'l', MOD(.alt = 1, .shift = 1), PTR());
+	check(a->x < c->x && c->x < b->x);
+
+	/* Windows outside the tag can not be dragged */
+	win_t other = {.w = 100, .h = 100};
+	int moved = moves;
+	wm_handle_event(&other, EV_MOUSE3, MOD(.alt = 1), PTR(.rx = 1, .ry = 1));
+	wm_handle_ptr(&other, PTR(.rx = 51, .ry = 1));
+	check(moves == moved);
+
+	/* The left column goes away while widening b over c */
+	wm_handle_event(b, EV_MOUSE3, MOD(.alt = 1),
+			PTR(.rx = b->x+1, .ry = b->y+1));
+	wm_remove(a);
+	wm_handle_ptr(b, PTR(.rx = b->x-99, .ry = b->y+1));
+	wm_handle_event(b, EV_MOUSE3, MOD(.alt = 1, .up = 1), PTR());
+	check(c->x == 0 && b->x == c->w);
+	check(b->w > c->w);
+
+	/* The dragged window goes away, in a column of three */
+	wm_handle_event(c, EV_ENTER, MOD(), PTR());
+	win_t *d = wins_new(1), *e = wins_new(1);
+	check(c->x == d->x && d->x == e->x && c->y < d->y && d->y < e->y);
+	wm_handle_event(d, EV_MOUSE3, MOD(.alt = 1),
+			PTR(.rx = d->x+1, .ry = d->y+1));
+	wm_remove(d);
+	free(d);
+	int height = c->h;
+	wm_handle_ptr(c, PTR(.rx = 1, .ry = 51));
+	wm_handle_event(c, EV_MOUSE3, MOD(.alt = 1, .up = 1), PTR());
+	check(c->h == height && e->h == height);
+	wm_free();
+	free(wins);
+	free(e);
+}
+
+static void test_drag_rate(void)
+{
+	/* Three columns, a | c | b, resizing c into b */
+	conf_set_int("main.drag-rate", 50);
+	wm_init();
+	win_t *wins = wins_new(3), *a = &wins[0], *b = &wins[1], *c = &wins[2];
+	wm_handle_event(c, 'l', MOD(.alt = 1, .shift = 1), PTR());
+	wm_handle_event(b, EV_ENTER, MOD(), PTR());
+	wm_handle_event(b, 'l', MOD(.alt = 1, .shift = 1), PTR());
+	wm_handle_event(b, 'l', MOD(.alt = 1, .shift = 1), PTR());
+	int x = c->x + c->w - 1, width = c->w + b->w;
+	win_t left = *a;
+
+	/* The first motion is laid out at once, only c and b move */
+	int moved = moves, set = timers;
+	wm_handle_event(c, EV_MOUSE3, MOD(.alt = 1), PTR(.rx = x, .ry = 1));
+	wm_handle_ptr(c, PTR(.rx = x+10, .ry = 1));
+	check(moves == moved+2 && c->w + b->w == width);
+	check(!memcmp(&left, a, sizeof(win_t)));
+
+	/* Later motions wait for a single timer */
+	int last = c->w;
+	wm_handle_ptr(c, PTR(.rx = x+20, .ry = 1));
+	wm_handle_ptr(c, PTR(.rx = x+30, .ry = 1));
+	check(c->w == last && timers == set+1);
+	check(0 < timer && timer <= 20);
+	usleep(timer * 1000);
+	wm_handle_timer();
+	check(c->w > last && c->w + b->w == width);
+	check(moves == moved+4);
+
+	/* Release lays out the last motion exactly */
+	last = c->w;
+	wm_handle_ptr(c, PTR(.rx = x+40, .ry = 1));
+	check(c->w == last && timers == set+2);
+	wm_handle_event(c, EV_MOUSE3, MOD(.alt = 1, .up = 1), PTR());
+	check(c->w > last && c->w + b->w == width);
+	moved = moves;
+	wm_handle_timer();
+	wm_handle_event(NULL, EV_F5, MOD(.alt = 1), PTR());
+	check(moves == moved);
+	wm_free();
+	free(wins);
+	conf_set_int("main.drag-rate", 60);
+}
+
+static void bench_layout(void)
+{
+	/* Full relayouts of a tag, forced by resizing the screen */
+	int sizes[] = {10, 100, 1000};
+	for (int i = 0; i < countof(sizes); i++) {
+		int  n = sizes[i], rounds = 100000 / n;
+		char name[32];
+		wm_init();
+		snprintf(name, sizeof(name), "wm_insert %d", n);
+		long long start = get_nsec();
+		win_t *wins = wins_new(n);
+		report(name, n, start);
+
+		snprintf(name, sizeof(name), "layout %d", n);
+		start = get_nsec();
+		for (int r = 0; r < rounds; r++) {
+			screen.h = r % 2 ? 800 : 799;
+			wm_handle_screen(&screen);
+		}
+		report(name, rounds, start);
+		screen.h = 800;
+		wm_free();
+		free(wins);
+	}
+}
+
+static void bench_tag_switch(void)
+{
+	/* Switch away from a 20 window tag and back */
+	int n = 20, rounds = 10000;
+	wm_init();
+	win_t *wins = wins_new(n);
+	wm_handle_event(&wins[0], 'l', MOD(.alt = 1, .shift = 1), PTR());
+	int moved = moves, shown = shows;
+	long long start = get_nsec();
+	for (int r = 0; r < rounds; r++) {
+		wm_handle_event(NULL, '2', MOD(.alt = 1), PTR());
+		wm_handle_event(NULL, '1', MOD(.alt = 1), PTR());
+	}
+	report("tag switch 20", rounds*2, start);
+	printf("%-24s %8.1f moves %5.1f shows per switch\n", "",
+			(moves - moved) / (rounds*2.0),
+			(shows - shown) / (rounds*2.0));
+	wm_free();
+	free(wins);
+}
+
+/* X11 core */
+struct win_sys {
+	x11_t x11;
+};
+
+static win_t *xwins_new(int n)
+{
+	win_t     *wins = calloc(n, sizeof(win_t));
+	win_sys_t *sys  = calloc(n, sizeof(win_sys_t));
+	for (int i = 0; i < n; i++) {
+		wins[i].sys     = &sys[i];
+		sys[i].x11.xid = 0x200001 + i*8;
+	}
+	return wins;
+}
+
+static void xwins_free(win_t *wins)
+{
+	free(wins[0].sys);
+	free(wins);
+}
+
+static void xwin_drop(win_t *win)
+{
+}
+
+static void test_x11_cache(void)
+{
+	int n = 100;
+	win_t *wins = xwins_new(n), dup = {.sys = &(win_sys_t){}};
+	for (int i = 0; i < n; i++)
+		check(x11_win_add(&wins[i]) == &wins[i]);
+	X11(&dup)->xid = X11(&wins[7])->xid;
+	check(x11_win_add(&dup) == &wins[7]);
+	for (int i = 0; i < n; i += 2)
+		x11_win_del(&wins[i]);
+	for (int i = 0; i < n; i++)
+		check(x11_win_find(X11(&wins[i])->xid) == (i%2 ? &wins[i] : NULL));
+	check(x11_win_find(0) == NULL);
+	x11_free(xwin_drop);
+	xwins_free(wins);
+}
+
+static void test_x11_move(void)
+{
+	win_t *win = xwins_new(1);
+	x11_win_add(win);
+	x11_need_sync();
+	check(x11_move(win, -10, 0, 100, 50, 1) == 1);
+	check(win->x == -10 && win->w == 100 && win->h == 50);
+	check(X11(win)->geom.w == 98 && X11(win)->geom.h == 48);
+	check(x11_need_sync() == 1);
+	check(x11_move(win, -10, 0, 100, 50, 1) == 0);
+	check(x11_need_sync() == 0);
+	check(x11_geom(win, -1, -1, -1, -1, 2) == 1);
+	check(x11_geom(win, -1, -1, 98, -1, 2) == 0);
+	check(x11_need_sync() == 1);
+	x11_free(xwin_drop);
+	xwins_free(win);
+}
+
+static void test_x11_strut(void)
+{
+	/* A top bar across the left monitor only */
+	win_t  *bar = xwins_new(1);
+	strut_t top = {.top = 20, .top_start_x = 0, .top_end_x = 999};
+	wm_init();
+	x11_screen(0,    0, 1000, 800);
+	x11_screen(1000, 0, 1000, 600);
+	x11_win_add(bar);
+	check(x11_strut(bar, &top) == 1);
+	check(list_length(x11_struts()) == 1);
+
+	geom_t max, full;
+	win_t  left = {.x = 10, .y = 10}, right = {.x = 1010, .y = 10};
+	x11_area(&left, &max, &full);
+	check(max.x == 0 && max.y == 20 && max.w == 1000 && max.h == 780);
+	check(full.h == 800);
+	x11_area(&right, &max, &full);
+	check(max.x == 1000 && max.y == 0 && max.h == 600);
+
+	/* Plain struts cover the whole edge */
+	check(x11_strut(bar, &(strut_t){.top = 30}) == 1);
+	x11_area(&right, &max, &full);
+	check(max.y == 30 && max.h == 570);
+
+	x11_win_del(bar);
+	check(x11_struts() == NULL);
+	x11_area(&left, &max, &full);
+	check(max.y == 0 && max.h == 800);
+	wm_free();
+	x11_free(xwin_drop);
+	xwins_free(bar);
+}
+
+static void bench_x11(void)
+{
+	int n = 1000, rounds = 1000000;
+	win_t *wins = xwins_new(n);
+	for (int i = 0; i < n; i++)
+		x11_win_add(&wins[i]);
+
+	long long start = get_nsec();
+	for (int i = 0; i < rounds; i++)
+		x11_win_find(X11(&wins[i % n])->xid);
+	report("x11_win_find", rounds, start);
+
+	start = get_nsec();
+	for (int i = 0; i < rounds; i++)
+		x11_move(&wins[i % n], 0, 0, 100, 100, 1);
+	report("x11_move cached", rounds, start);
+
+	start = get_nsec();
+	for (int i = 0; i < rounds; i++)
+		x11_move(&wins[i % n], 0, 0, 100, 100 + i%2, 1);
+	report("x11_move changed", rounds, start);
+
+	x11_free(xwin_drop);
+	xwins_free(wins);
+}
+
+/* Main */
+static struct {
+	const char *name;
+	void (*func)(void);
+} tests[] = {
+	{"hash_put_get", test_hash_put_get },
+	{"hash_grow",    test_hash_grow    },
+	{"hash_wrap",    test_hash_wrap    },
+	{"hash_random",  test_hash_random  },
+	{"hash_str",     test_hash_str     },
+	{"vector",       test_vector       },
+	{"list_sort",    test_list_sort    },
+	{"list_sort_eq", test_list_sort_equal },
+	{"pool",         test_pool         },
+	{"layout",       test_layout       },
+	{"focus",        test_focus        },
+	{"float",        test_float        },
+	{"drag",         test_drag         },
+	{"drag_rate",    test_drag_rate    },
+	{"x11_cache",    test_x11_cache    },
+	{"x11_move",     test_x11_move     },
+	{"x11_strut",    test_x11_strut    },
+}, benches[] = {
+	{"hash",         bench_hash        },
+	{"vector",       bench_vector      },
+	{"list_churn",   bench_list_churn  },
+	{"list_sort",    bench_list_sort   },
+	{"layout",       bench_layout      },
+	{"tag_switch",   bench_tag_switch  },
+	{"x11",          bench_x11         },
+};
+
+int main(int argc, char **argv)
+{
+	int bench = argc > 1 && !strcmp(argv[1], "bench");
+	if (bench) {
+		for (int i = 0; i < countof(benches); i++)
+			benches[i].func();
+	} else {
+		for (int i = 0; i < countof(tests); i++) {
+			int before = failed;
+			tests[i].func();
+			printf("%-24s %s\n", tests[i].name,
+					failed == before ? "ok" : "FAILED");
+		}
+	}
+	sys_free();
+	return !!failed;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2011, Andy Spencer <andy753421@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ */
+
+/* Decoder for trace ring dumps written by ring_dump */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+static const char *names[] = {
+	[RING_EVENT]  "event",
+	[RING_MOVE]   "move",
+	[RING_SHOW]   "show",
+	[RING_RAISE]  "raise",
+	[RING_FOCUS]  "focus",
+	[RING_UPDATE] "update",
+	[RING_TAG]    "tag",
+	[RING_INSERT] "insert",
+	[RING_REMOVE] "remove",
+};
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "/tmp/wmpus.trace";
+	FILE *fd = fopen(path, "rb");
+	if (!fd)
+		return fprintf(stderr, "Error: cannot open %s\n", path), 1;
+
+	char magic[4];
+	int  head[2];
+	if (fread(magic, sizeof(magic), 1, fd) != 1 ||
+	    fread(head,  sizeof(head),  1, fd) != 1 ||
+	    memcmp(magic, RING_MAGIC, 4) || head[0] != sizeof(ring_t))
+		return fprintf(stderr, "Error: %s is not a trace dump\n", path), 1;
+
+	ring_t rec;
+	long long start = 0;
+	for (int i = 0; i < head[1] && fread(&rec, sizeof(rec), 1, fd) == 1; i++) {
+		if (i == 0)
+			start = rec.time;
+		const char *name = rec.op >= 0 && rec.op < countof(names)
+			&& names[rec.op] ? names[rec.op] : "unknown";
+		printf("%12.6f %-6s %-10lx", (rec.time-start)/1E9, name, rec.id);
+		switch (rec.op) {
+		case RING_EVENT:  printf(" type=%d",        rec.a);                        break;
+		case RING_MOVE:   printf(" %dx%d @ %d,%d",  rec.c, rec.d, rec.a, rec.b);   break;
+		case RING_SHOW:   printf(" state=%d",       rec.a);                        break;
+		case RING_UPDATE: printf(" touched=%d changed=%d", rec.a, rec.b);          break;
+		case RING_TAG:    printf(" tag=%c %dus",    rec.a, rec.b);                 break;
+		}
+		printf("\n");
+	}
+
+	fclose(fd);
+	return 0;
+}
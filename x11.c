@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2015 Andy Spencer <andy753421@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <poll.h>
+
+#include "util.h"
+#include "types.h"
+#include "wm.h"
+#include "x11.h"
+
+/* Internal structures */
+typedef struct {
+	win_t  area;  // usable area, this is what the wm sees
+	geom_t full;  // full monitor geometry
+} screen_t;
+
+/* Window cache, indexed by xid */
+#define xid_eq(a, b) ((a) == (b))
+HASHMAP(cache, unsigned int, win_t*, hash_int, xid_eq)
+
+/* Global data */
+static cache_t cache;
+static list_t *screens;
+static list_t *struts;
+static int     dirty;
+static long long timer;
+
+/* Debug names */
+static char *state_map[] = {
+	[ST_HIDE ] "hide ",
+	[ST_SHOW ] "show ",
+	[ST_FULL ] "full ",
+	[ST_MAX  ] "max  ",
+	[ST_SHADE] "shade",
+	[ST_ICON ] "icon ",
+	[ST_CLOSE] "close",
+};
+
+/* Window cache */
+win_t *x11_win_find(unsigned int xid)
+{
+	win_t **win = cache_get(&cache, xid);
+	return win ? *win : NULL;
+}
+
+win_t *x11_win_add(win_t *win)
+{
+	X11(win)->geom = (geom_t){-1, -1, -1, -1, -1};
+	win_t **old = cache_get(&cache, X11(win)->xid);
+	return old ? *old : *cache_put(&cache, X11(win)->xid, win);
+}
+
+void x11_win_del(win_t *win)
+{
+	x11_strut(win, NULL);
+	cache_del(&cache, X11(win)->xid);
+}
+
+/* Screens and struts
+ *   Struts are spaces at the edges of the screen that are used by
+ *   toolbars and statusbars such as dzen. Each strut reserves a
+ *   rectangle along an edge of the root window, the usable area of
+ *   a monitor is recomputed from scratch from the reserved
+ *   rectangles that touch it, so nothing drifts when struts change */
+static void screen_root(int *w, int *h)
+{
+	*w = *h = 0;
+	for (list_t *cur = screens; cur; cur = cur->next) {
+		geom_t *full = &((screen_t*)cur->data)->full;
+		*w = MAX(*w, full->x + full->w);
+		*h = MAX(*h, full->y + full->h);
+	}
+}
+
+static int span(int start, int end, int pos, int size)
+{
+	return start < pos + size && end >= pos;
+}
+
+/* Space reserved by strut along each edge of the monitor */
+static strut_t strut_clip(strut_t *strut, geom_t *full, int rw, int rh)
+{
+	strut_t clip = {};
+	if (span(strut->left_start_y, strut->left_end_y, full->y, full->h))
+		clip.left   = strut->left - full->x;
+	if (span(strut->right_start_y, strut->right_end_y, full->y, full->h))
+		clip.right  = strut->right - (rw - full->x - full->w);
+	if (span(strut->top_start_x, strut->top_end_x, full->x, full->w))
+		clip.top    = strut->top - full->y;
+	if (span(strut->bottom_start_x, strut->bottom_end_x, full->x, full->w))
+		clip.bottom = strut->bottom - (rh - full->y - full->h);
+	clip.left   = MIN(MAX(clip.left,   0), full->w);
+	clip.right  = MIN(MAX(clip.right,  0), full->w);
+	clip.top    = MIN(MAX(clip.top,    0), full->h);
+	clip.bottom = MIN(MAX(clip.bottom, 0), full->h);
+	return clip;
+}
+
+static int strut_hits(strut_t *strut, geom_t *full, int rw, int rh)
+{
+	strut_t clip = strut_clip(strut, full, rw, rh);
+	return clip.left || clip.right || clip.top || clip.bottom;
+}
+
+/* Returns non-zero if the usable area changed */
+static int screen_update(screen_t *screen, int rw, int rh)
+{
+	geom_t *full = &screen->full;
+	strut_t use  = {};
+	for (list_t *cur = struts; cur; cur = cur->next) {
+		strut_t clip = strut_clip(&X11((win_t*)cur->data)->strut,
+				full, rw, rh);
+		use.left   = MAX(use.left,   clip.left);
+		use.right  = MAX(use.right,  clip.right);
+		use.top    = MAX(use.top,    clip.top);
+		use.bottom = MAX(use.bottom, clip.bottom);
+	}
+	win_t *area = &screen->area;
+	win_t  prev = *area;
+	area->x = full->x + use.left;
+	area->y = full->y + use.top;
+	area->w = MAX(full->w - use.left - use.right,  1);
+	area->h = MAX(full->h - use.top  - use.bottom, 1);
+	return area->x != prev.x || area->y != prev.y ||
+	       area->w != prev.w || area->h != prev.h;
+}
+
+void x11_screen(int x, int y, int w, int h)
+{
+	int rw, rh;
+	screen_t *screen = new0(screen_t);
+	screen->full = (geom_t){x, y, w, h};
+	screens = list_append(screens, screen);
+	screen_root(&rw, &rh);
+	for (list_t *cur = screens; cur; cur = cur->next)
+		screen_update(cur->data, rw, rh);
+}
+
+list_t *x11_screens(void)
+{
+	return screens;
+}
+
+list_t *x11_struts(void)
+{
+	return struts;
+}
+
+int x11_strut(win_t *win, strut_t *strut)
+{
+	strut_t *cur  = &X11(win)->strut;
+	strut_t  old  = *cur;
+	list_t  *link = list_find(struts, win);
+
+	/* Plain _NET_WM_STRUT covers the whole edge */
+	*cur = strut ? *strut : (strut_t){};
+	if (!cur->left_end_y   && !cur->right_end_y &&
+	    !cur->top_end_x    && !cur->bottom_end_x) {
+		cur->left_end_y   = cur->right_end_y  = INT_MAX;
+		cur->top_end_x    = cur->bottom_end_x = INT_MAX;
+	}
+
+	int set = cur->left || cur->right || cur->top || cur->bottom;
+	if (link && !set)
+		struts = list_remove(struts, link, 0);
+	if (!link && set)
+		struts = list_insert(struts, win);
+	if (!link && !set)
+		return 0;
+
+	/* Only monitors touched by the old or new strut are updated */
+	int rw, rh;
+	screen_root(&rw, &rh);
+	for (list_t *lscr = screens; lscr; lscr = lscr->next) {
+		screen_t *screen = lscr->data;
+		if (!strut_hits(&old, &screen->full, rw, rh) &&
+		    !strut_hits(cur,  &screen->full, rw, rh))
+			continue;
+		if (screen_update(screen, rw, rh))
+			wm_handle_screen(&screen->area);
+	}
+	return set;
+}
+
+void x11_area(win_t *win, geom_t *max, geom_t *full)
+{
+	screen_t *screen = NULL;
+	for (list_t *cur = screens; cur; cur = cur->next) {
+		screen = cur->data;
+		geom_t *geom = &screen->full;
+		if (win->x >= geom->x && win->x < geom->x+geom->w &&
+		    win->y >= geom->y && win->y < geom->y+geom->h)
+			break;
+	}
+	if (!screen) {
+		*max = *full = (geom_t){win->x, win->y, win->w, win->h};
+		return;
+	}
+	win_t *area = &screen->area;
+	*max  = (geom_t){area->x, area->y, area->w, area->h};
+	*full = screen->full;
+}
+
+/* Geometry cache */
+int x11_geom(win_t *win, int x, int y, int w, int h, int b)
+{
+	geom_t *geom = &X11(win)->geom;
+	int changed = (x >= 0 && x != geom->x) || (y >= 0 && y != geom->y) ||
+	              (w >= 0 && w != geom->w) || (h >= 0 && h != geom->h) ||
+	              (b >= 0 && b != geom->b);
+	if (x >= 0) geom->x = x;
+	if (y >= 0) geom->y = y;
+	if (w >= 0) geom->w = w;
+	if (h >= 0) geom->h = h;
+	if (b >= 0) geom->b = b;
+	if (changed)
+		x11_mark_dirty();
+	return changed;
+}
+
+int x11_move(win_t *win, int x, int y, int w, int h, int border)
+{
+	int b = 2*border;
+	win->x = x;
+	win->y = y;
+	win->w = MAX(w,1+b);
+	win->h = MAX(h,1+b);
+
+	/* Positions can be negative so all fields are compared */
+	geom_t *geom = &X11(win)->geom;
+	geom_t  next = {x, y, MAX(w-b,1), MAX(h-b,1), geom->b};
+	if (geom->x == next.x && geom->y == next.y &&
+	    geom->w == next.w && geom->h == next.h)
+		return 0;
+	*geom = next;
+	x11_mark_dirty();
+	return 1;
+}
+
+/* Layout sync */
+void x11_mark_dirty(void)
+{
+	dirty = 1;
+}
+
+int x11_need_sync(void)
+{
+	int was = dirty;
+	dirty = 0;
+	return was;
+}
+
+/* Timer */
+void x11_timer(int msec)
+{
+	timer = get_nsec() + msec*1000000LL;
+}
+
+int x11_wait(int fd)
+{
+	struct pollfd pfd = {.fd = fd, .events = POLLIN};
+	while (timer) {
+		long long left = timer - get_nsec();
+		if (left <= 0)
+			break;
+		int ready = poll(&pfd, 1, (left + 999999) / 1000000);
+		if (ready > 0)
+			return 1;
+		if (ready == 0)
+			break;
+	}
+	if (!timer)
+		return 1;
+	timer = 0;
+	return 0;
+}
+
+/* Misc */
+const char *x11_state(state_t state)
+{
+	return state_map[state];
+}
+
+void x11_free(void (*func)(win_t *win))
+{
+	while (struts)
+		struts = list_remove(struts, struts, 0);
+	while (screens)
+		screens = list_remove(screens, screens, 1);
+	hash_foreach(&cache, slot)
+		func(slot->val);
+	cache_free(&cache);
+}
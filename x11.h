@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2015 Andy Spencer <andy753421@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ */
+
+/* X11 core:
+ *
+ * The xlib and xcb backends only differ in how they talk to
+ * the X server. Everything else, the window cache, toolbar
+ * struts, screen geometry and the geometry cache, is kept here
+ * so that both backends share it. */
+
+/* Toolbar struts, from _NET_WM_STRUT_PARTIAL
+ *   The start and end fields are left zero for _NET_WM_STRUT
+ *   in which case the strut covers the whole edge */
+typedef struct {
+	int left, right, top, bottom;
+	int left_start_y,   left_end_y;
+	int right_start_y,  right_end_y;
+	int top_start_x,    top_end_x;
+	int bottom_start_x, bottom_end_x;
+} strut_t;
+
+/* Supported WM_PROTOCOLS */
+typedef enum {
+	PROTO_DELETE = 1 << 0, // WM_DELETE_WINDOW
+	PROTO_FOCUS  = 1 << 1, // WM_TAKE_FOCUS
+} proto_t;
+
+/* Window geometry, -1 for unknown fields */
+typedef struct {
+	int x, y, w, h, b;
+} geom_t;
+
+/* Common window data
+ *   This must be the first member of each backend's win_sys */
+typedef struct {
+	unsigned int xid;    // X11 window id
+	strut_t      strut;  // toolbar struts
+	proto_t      protos; // supported WM_PROTOCOLS
+	geom_t       geom;   // geometry last sent to the server
+} x11_t;
+
+#define X11(win) ((x11_t*)(win)->sys)
+
+/* Window cache, x11_win_add returns the cached window if the
+ * xid is already known */
+win_t *x11_win_find(unsigned int xid);
+
+win_t *x11_win_add(win_t *win);
+
+void x11_win_del(win_t *win);
+
+/* Screens and struts
+ *   x11_strut replaces the struts for a window, a NULL or
+ *   empty strut removes it. The usable area of each monitor the
+ *   strut touches is recomputed and wm_handle_screen is called
+ *   for the ones that changed. x11_area finds the screen for a
+ *   window, max is the usable area and full is the monitor */
+void x11_screen(int x, int y, int w, int h);
+
+list_t *x11_screens(void);
+
+list_t *x11_struts(void);
+
+int x11_strut(win_t *win, strut_t *strut);
+
+void x11_area(win_t *win, geom_t *max, geom_t *full);
+
+/* Geometry cache
+ *   Returns non-zero if the geometry sent to the server needs to
+ *   change, x11_move also updates the wm geometry in win */
+int x11_geom(win_t *win, int x, int y, int w, int h, int b);
+
+int x11_move(win_t *win, int x, int y, int w, int h, int border);
+
+/* Layout sync
+ *   The geometry cache marks the layout dirty whenever a window
+ *   moves. x11_need_sync returns non-zero, and clears the mark,
+ *   if anything moved since the last call, so the backend can
+ *   sync once per event and drop the crossing events it caused */
+void x11_mark_dirty(void);
+
+int x11_need_sync(void);
+
+/* Timer
+ *   x11_wait blocks until fd is readable or the timer set with
+ *   x11_timer expires, it returns 0 once when the timer expires
+ *   and returns 1 straight away when no timer is set */
+void x11_timer(int msec);
+
+int x11_wait(int fd);
+
+/* Misc */
+const char *x11_state(state_t state);
+
+void x11_free(void (*func)(win_t *win));